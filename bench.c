@@ -0,0 +1,828 @@
+/* Benchmarks of the queue operations, see bench.h */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "bench.h"
+#include "console.h"
+#include "report.h"
+
+/* The benchmark keeps its own bookkeeping in regular memory */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "queue.h"
+
+/* Repetitions of each measurement, the fastest one is reported */
+static int bench_reps = 3;
+
+/* K of reverseK, and the number of queues merge works on */
+static int bench_k = 4;
+
+typedef enum { FMT_CSV, FMT_JSON, N_FMT } bench_fmt_t;
+static int bench_fmt = FMT_CSV;
+
+/* Hardware counters */
+
+typedef enum {
+    CNT_CYCLES,
+    CNT_INSTRUCTIONS,
+    CNT_CACHE_MISSES,
+    CNT_BRANCH_MISSES,
+    N_COUNTERS,
+} counter_t;
+
+static int counter_fd[N_COUNTERS];
+static bool counters_opened = false;
+
+/* Open every counter the kernel provides, the others stay at -1 */
+static void counters_open()
+{
+    if (counters_opened)
+        return;
+    counters_opened = true;
+
+    for (int i = 0; i < N_COUNTERS; i++)
+        counter_fd[i] = -1;
+#if defined(__linux__)
+    static const uint64_t config[N_COUNTERS] = {
+        [CNT_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+        [CNT_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+        [CNT_CACHE_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+        [CNT_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    for (int i = 0; i < N_COUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        counter_fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+}
+
+static void counters_start()
+{
+#if defined(__linux__)
+    for (int i = 0; i < N_COUNTERS; i++) {
+        if (counter_fd[i] >= 0) {
+            ioctl(counter_fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+/* Stop the counters and store their values, -1 for the unavailable ones */
+static void counters_stop(double *val)
+{
+    for (int i = 0; i < N_COUNTERS; i++) {
+        val[i] = -1;
+#if defined(__linux__)
+        uint64_t count;
+        if (counter_fd[i] >= 0) {
+            ioctl(counter_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counter_fd[i], &count, sizeof(count)) == sizeof(count))
+                val[i] = count;
+        }
+#endif
+    }
+}
+
+/* Input strings */
+
+/* Generate @n strings of lowercase letters in one block. The generator is
+ * seeded the same way every time, so that different builds see the same
+ * input.
+ */
+static char **strings_new(int n, int min_len, int max_len)
+{
+    char **strs = malloc(sizeof(char *) * n);
+    int *lens = malloc(sizeof(int) * n);
+    if (!strs || !lens) {
+        free(strs);
+        free(lens);
+        return NULL;
+    }
+
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    size_t total = 0;
+    for (int i = 0; i < n; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        lens[i] = min_len + state % (max_len - min_len + 1);
+        total += lens[i] + 1;
+    }
+
+    char *buf = malloc(total);
+    if (!buf) {
+        free(strs);
+        free(lens);
+        return NULL;
+    }
+    for (int i = 0; i < n; i++) {
+        strs[i] = buf;
+        for (int j = 0; j < lens[i]; j++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            buf[j] = 'a' + state % 26;
+        }
+        buf[lens[i]] = '\0';
+        buf += lens[i] + 1;
+    }
+    free(lens);
+    return strs;
+}
+
+static void strings_free(char **strs)
+{
+    if (strs)
+        free(strs[0]);
+    free(strs);
+}
+
+/* Complexity classes the scaling fit chooses from */
+typedef enum {
+    O_1,
+    O_LOG_N,
+    O_N,
+    O_N_LOG_N,
+    O_N2,
+    N_ORDERS,
+} order_t;
+
+static const char *order_name[N_ORDERS] = {
+    "O(1)", "O(log n)", "O(n)", "O(n log n)", "O(n^2)",
+};
+
+/* Powers of n, ignoring logarithmic factors */
+static const int order_degree[N_ORDERS] = {0, 0, 1, 1, 2};
+
+static double order_eval(order_t order, double n)
+{
+    switch (order) {
+    case O_1:
+        return 1;
+    case O_LOG_N:
+        return log2(n);
+    case O_N:
+        return n;
+    case O_N_LOG_N:
+        return n * log2(n);
+    default:
+        return n * n;
+    }
+}
+
+/* Operations */
+
+typedef struct {
+    int n;
+    char **strs;
+    struct list_head *q;
+    struct list_head chain; /* of queue_contex_t, for merge */
+} bench_ctx_t;
+
+typedef struct {
+    char *name;
+    /* Build the input of one repetition, not measured */
+    bool (*setup)(bench_ctx_t *ctx);
+    /* The measured part, returns the number of calls made */
+    long (*run)(bench_ctx_t *ctx);
+    /* Expected cost of a single call */
+    order_t order;
+} bench_op_t;
+
+static bool setup_empty(bench_ctx_t *ctx)
+{
+    ctx->q = q_new();
+    return ctx->q;
+}
+
+static bool setup_filled(bench_ctx_t *ctx)
+{
+    if (!setup_empty(ctx))
+        return false;
+    for (int i = 0; i < ctx->n; i++) {
+        if (!q_insert_tail(ctx->q, ctx->strs[i]))
+            return false;
+    }
+    return true;
+}
+
+static bool setup_sorted(bench_ctx_t *ctx)
+{
+    if (!setup_filled(ctx))
+        return false;
+    q_sort(ctx->q, false);
+    return true;
+}
+
+/* Deal the strings round robin into bench_k sorted queues */
+static bool setup_chain(bench_ctx_t *ctx)
+{
+    for (int i = 0; i < bench_k; i++) {
+        queue_contex_t *qctx = malloc(sizeof(queue_contex_t));
+        if (!qctx)
+            return false;
+        qctx->q = q_new();
+        qctx->size = 0;
+        qctx->id = i;
+        list_add_tail(&qctx->chain, &ctx->chain);
+        if (!qctx->q)
+            return false;
+    }
+
+    queue_contex_t *qctx = NULL;
+    for (int i = 0; i < ctx->n; i++) {
+        struct list_head *pos = qctx ? qctx->chain.next : ctx->chain.next;
+        if (pos == &ctx->chain)
+            pos = pos->next;
+        qctx = list_entry(pos, queue_contex_t, chain);
+        if (!q_insert_tail(qctx->q, ctx->strs[i]))
+            return false;
+        qctx->size++;
+    }
+    list_for_each_entry (qctx, &ctx->chain, chain)
+        q_sort(qctx->q, false);
+    return true;
+}
+
+static long run_ih(bench_ctx_t *ctx)
+{
+    for (int i = 0; i < ctx->n; i++)
+        q_insert_head(ctx->q, ctx->strs[i]);
+    return ctx->n;
+}
+
+static long run_it(bench_ctx_t *ctx)
+{
+    for (int i = 0; i < ctx->n; i++)
+        q_insert_tail(ctx->q, ctx->strs[i]);
+    return ctx->n;
+}
+
+/* Removal includes releasing the element, as a caller has to */
+static long run_rh(bench_ctx_t *ctx)
+{
+    char buf[4096];
+    for (int i = 0; i < ctx->n; i++)
+        q_release_element(q_remove_head(ctx->q, buf, sizeof(buf)));
+    return ctx->n;
+}
+
+static long run_rt(bench_ctx_t *ctx)
+{
+    char buf[4096];
+    for (int i = 0; i < ctx->n; i++)
+        q_release_element(q_remove_tail(ctx->q, buf, sizeof(buf)));
+    return ctx->n;
+}
+
+static long run_size(bench_ctx_t *ctx)
+{
+    volatile int sink = 0;
+    for (int i = 0; i < ctx->n; i++)
+        sink += q_size(ctx->q);
+    (void) sink;
+    return ctx->n;
+}
+
+static long run_dm(bench_ctx_t *ctx)
+{
+    q_delete_mid(ctx->q);
+    return 1;
+}
+
+static long run_dedup(bench_ctx_t *ctx)
+{
+    q_delete_dup(ctx->q);
+    return 1;
+}
+
+static long run_deduphash(bench_ctx_t *ctx)
+{
+    q_delete_dup_hash(ctx->q);
+    return 1;
+}
+
+static long run_swap(bench_ctx_t *ctx)
+{
+    q_swap(ctx->q);
+    return 1;
+}
+
+static long run_reverse(bench_ctx_t *ctx)
+{
+    q_reverse(ctx->q);
+    return 1;
+}
+
+static long run_reverseK(bench_ctx_t *ctx)
+{
+    q_reverseK(ctx->q, bench_k);
+    return 1;
+}
+
+static long run_sort(bench_ctx_t *ctx)
+{
+    q_sort(ctx->q, false);
+    return 1;
+}
+
+static long run_ascend(bench_ctx_t *ctx)
+{
+    q_ascend(ctx->q);
+    return 1;
+}
+
+static long run_descend(bench_ctx_t *ctx)
+{
+    q_descend(ctx->q);
+    return 1;
+}
+
+static long run_merge(bench_ctx_t *ctx)
+{
+    q_merge(&ctx->chain, false);
+    return 1;
+}
+
+static long run_free(bench_ctx_t *ctx)
+{
+    q_free(ctx->q);
+    ctx->q = NULL;
+    return 1;
+}
+
+static const bench_op_t bench_ops[] = {
+    {"ih", setup_empty, run_ih, O_1},
+    {"it", setup_empty, run_it, O_1},
+    {"rh", setup_filled, run_rh, O_1},
+    {"rt", setup_filled, run_rt, O_1},
+    {"size", setup_filled, run_size, O_1},
+    {"dm", setup_filled, run_dm, O_N},
+    {"dedup", setup_sorted, run_dedup, O_N},
+    {"deduphash", setup_filled, run_deduphash, O_N},
+    {"swap", setup_filled, run_swap, O_N},
+    {"reverse", setup_filled, run_reverse, O_N},
+    {"reverseK", setup_filled, run_reverseK, O_N},
+    {"sort", setup_filled, run_sort, O_N_LOG_N},
+    {"ascend", setup_filled, run_ascend, O_N},
+    {"descend", setup_filled, run_descend, O_N},
+    {"merge", setup_chain, run_merge, O_N},
+    {"free", setup_filled, run_free, O_N},
+};
+
+#define N_BENCH_OPS (sizeof(bench_ops) / sizeof(bench_ops[0]))
+
+static const bench_op_t *find_op(const char *name)
+{
+    for (size_t i = 0; i < N_BENCH_OPS; i++) {
+        if (!strcmp(bench_ops[i].name, name))
+            return &bench_ops[i];
+    }
+    return NULL;
+}
+
+static void ctx_release(bench_ctx_t *ctx)
+{
+    q_free(ctx->q);
+    ctx->q = NULL;
+
+    queue_contex_t *qctx, *tmp;
+    list_for_each_entry_safe (qctx, tmp, &ctx->chain, chain) {
+        q_free(qctx->q);
+        free(qctx);
+    }
+    INIT_LIST_HEAD(&ctx->chain);
+}
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Measure @bop as bench_measure() does */
+static bool measure_op(const bench_op_t *bop,
+                       int n,
+                       int min_len,
+                       int max_len,
+                       bench_result_t *res)
+{
+    if (n < 0 || min_len < 0 || max_len < min_len)
+        return false;
+
+    bench_ctx_t ctx = {.n = n, .q = NULL};
+    INIT_LIST_HEAD(&ctx.chain);
+    ctx.strs = strings_new(n ? n : 1, min_len, max_len);
+    if (!ctx.strs)
+        return false;
+
+    counters_open();
+    int saved_probability = fail_probability;
+    fail_probability = 0;
+
+    bool ok = true;
+    res->ns = -1;
+    for (int rep = 0; ok && rep < bench_reps; rep++) {
+        double cnt[N_COUNTERS], start;
+        long calls = 0;
+
+        if (exception_setup(false)) {
+            ok = bop->setup(&ctx);
+            if (ok) {
+                start = now_ns();
+                counters_start();
+                calls = bop->run(&ctx);
+                counters_stop(cnt);
+                start = now_ns() - start;
+            }
+        } else {
+            ok = false;
+        }
+        exception_cancel();
+        ok = ok && !error_check();
+
+        if (ok && (res->ns < 0 || start / calls < res->ns)) {
+            res->calls = calls;
+            res->ns = start / calls;
+            res->cycles = cnt[CNT_CYCLES] < 0 ? -1 : cnt[CNT_CYCLES] / calls;
+            res->instructions = cnt[CNT_INSTRUCTIONS] < 0
+                                    ? -1
+                                    : cnt[CNT_INSTRUCTIONS] / calls;
+            res->cache_misses = cnt[CNT_CACHE_MISSES] < 0
+                                    ? -1
+                                    : cnt[CNT_CACHE_MISSES] / calls;
+            res->branch_misses = cnt[CNT_BRANCH_MISSES] < 0
+                                     ? -1
+                                     : cnt[CNT_BRANCH_MISSES] / calls;
+        }
+        ctx_release(&ctx);
+    }
+
+    fail_probability = saved_probability;
+    strings_free(ctx.strs);
+    return ok;
+}
+
+bool bench_measure(const char *op,
+                   int n,
+                   int min_len,
+                   int max_len,
+                   bench_result_t *res)
+{
+    const bench_op_t *bop = find_op(op);
+    return bop && measure_op(bop, n, min_len, max_len, res);
+}
+
+/* Command line */
+
+/* Parse a string length range, either "L" or "MIN-MAX" */
+static bool parse_range(char *s, int *min_len, int *max_len)
+{
+    char *end;
+    long lo = strtol(s, &end, 10);
+    long hi = lo;
+    if (end != s && *end == '-')
+        hi = strtol(end + 1, &end, 10);
+    if (end == s || *end || lo < 0 || hi < lo || hi >= 4096)
+        return false;
+    *min_len = lo;
+    *max_len = hi;
+    return true;
+}
+
+/* Format a counter, empty in CSV and null in JSON if unavailable */
+static char *fmt_count(char *buf, size_t size, double val)
+{
+    if (val < 0)
+        snprintf(buf, size, "%s", bench_fmt == FMT_JSON ? "null" : "");
+    else
+        snprintf(buf, size, "%.1f", val);
+    return buf;
+}
+
+static void print_result(const char *op,
+                         int n,
+                         const char *range,
+                         const bench_result_t *res,
+                         bool first)
+{
+    char cyc[32], ins[32], cmiss[32], bmiss[32];
+    fmt_count(cyc, sizeof(cyc), res->cycles);
+    fmt_count(ins, sizeof(ins), res->instructions);
+    fmt_count(cmiss, sizeof(cmiss), res->cache_misses);
+    fmt_count(bmiss, sizeof(bmiss), res->branch_misses);
+
+    if (bench_fmt == FMT_CSV) {
+        report(1, "%s,%d,%s,%ld,%.1f,%s,%s,%s,%s", op, n, range, res->calls,
+               res->ns, cyc, ins, cmiss, bmiss);
+        return;
+    }
+    if (!first)
+        report(1, ",");
+    report_noreturn(
+        1,
+        "  {\"op\": \"%s\", \"size\": %d, \"length\": \"%s\", \"calls\": %ld, "
+        "\"ns\": %.1f, \"cycles\": %s, \"instructions\": %s, "
+        "\"cache_misses\": %s, \"branch_misses\": %s}",
+        op, n, range, res->calls, res->ns, cyc, ins, cmiss, bmiss);
+}
+
+/* Split @s at commas into at most @max pieces, in place */
+static int split_list(char *s, char **items, int max)
+{
+    int cnt = 0;
+    for (char *tok = strtok(s, ","); tok && cnt < max;
+         tok = strtok(NULL, ","))
+        items[cnt++] = tok;
+    return cnt;
+}
+
+#define MAX_BENCH_ITEMS 32
+
+/* Look up the operations listed in @list, comma separated or "all", which is
+ * split in place. An unknown name is reported.
+ *
+ * Return: the number of operations stored in @ops, -1 if a name is unknown
+ */
+static int parse_ops(char *list, const bench_op_t **ops)
+{
+    if (!strcmp(list, "all")) {
+        for (size_t i = 0; i < N_BENCH_OPS; i++)
+            ops[i] = &bench_ops[i];
+        return N_BENCH_OPS;
+    }
+
+    char *names[N_BENCH_OPS];
+    int cnt = split_list(list, names, N_BENCH_OPS);
+    for (int i = 0; i < cnt; i++) {
+        if (!(ops[i] = find_op(names[i]))) {
+            report(1, "Unknown operation '%s'", names[i]);
+            return -1;
+        }
+    }
+    return cnt;
+}
+
+static bool do_bench(int argc, char *argv[])
+{
+    if (argc > 4) {
+        report(1, "%s takes 0-3 arguments", argv[0]);
+        return false;
+    }
+
+    char ops_buf[256] = "all", sizes_buf[256] = "1000,10000,100000",
+         lens_buf[256] = "5-10";
+    if (argc > 1)
+        snprintf(ops_buf, sizeof(ops_buf), "%s", argv[1]);
+    if (argc > 2)
+        snprintf(sizes_buf, sizeof(sizes_buf), "%s", argv[2]);
+    if (argc > 3)
+        snprintf(lens_buf, sizeof(lens_buf), "%s", argv[3]);
+
+    /* Validate everything before the first measurement */
+    const bench_op_t *ops[N_BENCH_OPS];
+    int n_ops = parse_ops(ops_buf, ops);
+    if (n_ops < 0)
+        return false;
+
+    char *sizes[MAX_BENCH_ITEMS], *lens[MAX_BENCH_ITEMS];
+    int n_sizes = split_list(sizes_buf, sizes, MAX_BENCH_ITEMS);
+    int n_lens = split_list(lens_buf, lens, MAX_BENCH_ITEMS);
+    int size_val[MAX_BENCH_ITEMS], min_len[MAX_BENCH_ITEMS],
+        max_len[MAX_BENCH_ITEMS];
+    for (int i = 0; i < n_sizes; i++) {
+        if (!get_int(sizes[i], &size_val[i]) || size_val[i] < 1) {
+            report(1, "Invalid size '%s'", sizes[i]);
+            return false;
+        }
+    }
+    for (int i = 0; i < n_lens; i++) {
+        if (!parse_range(lens[i], &min_len[i], &max_len[i])) {
+            report(1, "Invalid string length '%s'", lens[i]);
+            return false;
+        }
+    }
+
+    if (bench_fmt == FMT_CSV)
+        report(1,
+               "op,size,length,calls,ns,cycles,instructions,cache_misses,"
+               "branch_misses");
+    else
+        report(1, "[");
+
+    bool ok = true, first = true;
+    for (int i = 0; ok && i < n_ops; i++) {
+        for (int j = 0; ok && j < n_sizes; j++) {
+            for (int l = 0; ok && l < n_lens; l++) {
+                bench_result_t res;
+                ok = measure_op(ops[i], size_val[j], min_len[l], max_len[l],
+                                &res);
+                if (!ok) {
+                    report(1, "ERROR: Could not run %s on %d elements",
+                           ops[i]->name, size_val[j]);
+                    break;
+                }
+                print_result(ops[i]->name, size_val[j], lens[l], &res, first);
+                first = false;
+            }
+        }
+    }
+
+    if (bench_fmt == FMT_JSON)
+        report(1, first ? "]" : "\n]");
+    return ok;
+}
+
+/* Fit t = c * f(n) for every class f, weighting each point by 1 / t so that
+ * the large sizes do not drown out the small ones. The class with the lowest
+ * relative error wins. Confidence tells how far the runner-up is behind: it
+ * is 0 when both fit equally well and approaches 1 as the runner-up's error
+ * grows.
+ */
+static order_t fit_order(const double *n,
+                         const double *t,
+                         int cnt,
+                         double *err,
+                         double *confidence)
+{
+    double errs[N_ORDERS];
+    order_t best = O_1;
+    for (int o = 0; o < N_ORDERS; o++) {
+        double sum_r = 0, sum_r2 = 0;
+        for (int i = 0; i < cnt; i++) {
+            double r = order_eval(o, n[i]) / t[i];
+            sum_r += r;
+            sum_r2 += r * r;
+        }
+        double c = sum_r / sum_r2, res = 0;
+        for (int i = 0; i < cnt; i++) {
+            double d = 1 - c * order_eval(o, n[i]) / t[i];
+            res += d * d;
+        }
+        errs[o] = sqrt(res / cnt);
+        if (errs[o] < errs[best])
+            best = o;
+    }
+
+    double second = INFINITY;
+    for (int o = 0; o < N_ORDERS; o++) {
+        if (o != best && errs[o] < second)
+            second = errs[o];
+    }
+    *err = errs[best];
+    *confidence = second > 0 ? 1 - errs[best] / second : 0;
+    return best;
+}
+
+/* Sizes grow by this factor from the smallest one */
+#define BIGO_MIN_SIZE 1024
+#define BIGO_GROWTH 4
+#define BIGO_MAX_POINTS 16
+
+/* Largest size tried by default */
+#define BIGO_MAX_SIZE 10000000
+
+/* Cache and TLB misses make linear walks look superlinear on large queues,
+ * so a class above the expected one only counts as an error when it fits
+ * clearly better than the others.
+ */
+#define BIGO_MIN_CONFIDENCE 0.5
+
+/* Stop growing once a single call takes this long */
+#define BIGO_CALL_LIMIT_NS 1e9
+
+static bool do_bigo(int argc, char *argv[])
+{
+    if (argc > 4) {
+        report(1, "%s takes 0-3 arguments", argv[0]);
+        return false;
+    }
+
+    char ops_buf[256] = "all";
+    int max_size = BIGO_MAX_SIZE, min_len = 5, max_len = 10;
+    if (argc > 1)
+        snprintf(ops_buf, sizeof(ops_buf), "%s", argv[1]);
+    if (argc > 2 && (!get_int(argv[2], &max_size) ||
+                     max_size < BIGO_MIN_SIZE * BIGO_GROWTH * BIGO_GROWTH)) {
+        report(1, "Largest size must be at least %d",
+               BIGO_MIN_SIZE * BIGO_GROWTH * BIGO_GROWTH);
+        return false;
+    }
+    if (argc > 3 && !parse_range(argv[3], &min_len, &max_len)) {
+        report(1, "Invalid string length '%s'", argv[3]);
+        return false;
+    }
+
+    const bench_op_t *ops[N_BENCH_OPS];
+    int n_ops = parse_ops(ops_buf, ops);
+    if (n_ops < 0)
+        return false;
+
+    bool ok = true;
+    for (int i = 0; i < n_ops; i++) {
+        const bench_op_t *bop = ops[i];
+        double n[BIGO_MAX_POINTS], t[BIGO_MAX_POINTS];
+        int cnt = 0;
+        for (long size = BIGO_MIN_SIZE;
+             size <= max_size && cnt < BIGO_MAX_POINTS; size *= BIGO_GROWTH) {
+            bench_result_t res;
+            if (!measure_op(bop, size, min_len, max_len, &res)) {
+                report(1, "ERROR: Could not run %s on %ld elements",
+                       bop->name, size);
+                return false;
+            }
+            report(2, "%s: %ld elements, %.1f ns per call", bop->name, size,
+                   res.ns);
+            n[cnt] = size;
+            t[cnt++] = res.ns > 0 ? res.ns : 1;
+            if (res.ns * res.calls > BIGO_CALL_LIMIT_NS)
+                break;
+        }
+        if (cnt < 3) {
+            report(1, "ERROR: %s is too slow to fit on %d sizes", bop->name,
+                   cnt);
+            ok = false;
+            continue;
+        }
+
+        double err, confidence;
+        order_t order = fit_order(n, t, cnt, &err, &confidence);
+        bool worse = order_degree[order] > order_degree[bop->order] &&
+                     confidence >= BIGO_MIN_CONFIDENCE;
+        report(1, "%-10s %-10s error %5.1f%%, confidence %3.0f%%", bop->name,
+               order_name[order], 100 * err, 100 * confidence);
+        if (worse) {
+            report(1, "ERROR: %s expected to be %s", bop->name,
+                   order_name[bop->order]);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static void reps_setter(int oldval)
+{
+    if (bench_reps < 1) {
+        report(1, "At least one repetition is needed");
+        bench_reps = oldval;
+    }
+}
+
+static void k_setter(int oldval)
+{
+    if (bench_k < 1) {
+        report(1, "K must be positive");
+        bench_k = oldval;
+    }
+}
+
+static void fmt_setter(int oldval)
+{
+    if (bench_fmt < 0 || bench_fmt >= N_FMT) {
+        report(1, "Unknown output format %d", bench_fmt);
+        bench_fmt = oldval;
+    }
+}
+
+void init_bench()
+{
+    ADD_COMMAND(bench,
+                "Measure queue operations (comma separated, or all) on "
+                "queues of the given sizes, with string lengths L or MIN-MAX",
+                "[ops] [sizes] [lengths]");
+    ADD_COMMAND(bigo,
+                "Fit the cost of queue operations (comma separated, or all) "
+                "to a complexity class, on sizes from 1024 up to max "
+                "(default: max == 10000000)",
+                "[ops] [max] [length]");
+    add_param("benchreps", &bench_reps,
+              "Repetitions of each benchmark, the fastest is reported",
+              reps_setter);
+    add_param("benchk", &bench_k,
+              "K of reverseK and number of queues merged in benchmarks",
+              k_setter);
+    add_param("benchfmt", &bench_fmt, "Benchmark output (0: CSV, 1: JSON)",
+              fmt_setter);
+}
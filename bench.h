@@ -0,0 +1,56 @@
+#ifndef LAB0_BENCH_H
+#define LAB0_BENCH_H
+
+/* Benchmarks of the queue operations.
+ *
+ * Each operation runs on freshly built queues of a given size, with strings
+ * whose lengths are drawn from a given range. Besides wall-clock time, the
+ * hardware counters for cycles, instructions, cache misses and branch misses
+ * are read through perf_event_open(2) where the kernel provides them.
+ */
+
+#include <stdbool.h>
+
+/**
+ * bench_result_t - Cost of one call to a queue operation
+ * @calls: calls made per repetition
+ * @ns: wall-clock time in nanoseconds
+ * @cycles: CPU cycles
+ * @instructions: instructions retired
+ * @cache_misses: last level cache misses
+ * @branch_misses: mispredicted branches
+ *
+ * Counters the kernel cannot provide are negative.
+ */
+typedef struct {
+    long calls;
+    double ns;
+    double cycles;
+    double instructions;
+    double cache_misses;
+    double branch_misses;
+} bench_result_t;
+
+/**
+ * bench_measure() - Measure the cost of a queue operation
+ * @op: name of the operation, as listed by the bench command
+ * @n: number of elements in queue
+ * @min_len: shortest string length
+ * @max_len: longest string length
+ * @res: receives the cost per call of the fastest repetition
+ *
+ * Queues are built and released outside of the measured region, and
+ * allocation failures are not injected.
+ *
+ * Return: false if @op is unknown or the operation could not be run
+ */
+bool bench_measure(const char *op,
+                   int n,
+                   int min_len,
+                   int max_len,
+                   bench_result_t *res);
+
+/* Register the bench command and its options with the console */
+void init_bench();
+
+#endif /* LAB0_BENCH_H */
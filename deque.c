@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "deque.h"
+#include "harness.h"
+
+_Static_assert(sizeof(deque_chunk_t) == DEQUE_CHUNK_SIZE,
+               "a chunk must fill exactly its cache lines");
+
+/* Take a chunk from the spares, or allocate one */
+static deque_chunk_t *chunk_get(deque_t *d)
+{
+    deque_chunk_t *c = d->spare;
+    if (c) {
+        d->spare = c->next;
+        return c;
+    }
+    c = aligned_alloc(DEQUE_CACHE_LINE, sizeof(deque_chunk_t));
+    if (c)
+        d->chunks++;
+    return c;
+}
+
+/* Give back a chunk that has just become empty. One spare is kept, so that
+ * pushing and popping across a chunk boundary does not allocate each time.
+ */
+static void chunk_put(deque_t *d, deque_chunk_t *c)
+{
+    if (d->spare) {
+        free(c);
+        d->chunks--;
+        return;
+    }
+    c->next = NULL;
+    d->spare = c;
+}
+
+void deque_init(deque_t *d)
+{
+    d->first = d->last = d->spare = NULL;
+    d->size = d->chunks = 0;
+}
+
+void deque_destroy(deque_t *d)
+{
+    deque_clear(d);
+    while (d->spare) {
+        deque_chunk_t *next = d->spare->next;
+        free(d->spare);
+        d->spare = next;
+    }
+    d->chunks = 0;
+}
+
+bool deque_push_front(deque_t *d, void *item)
+{
+    deque_chunk_t *c = d->first;
+    if (!c || !c->begin) {
+        c = chunk_get(d);
+        if (!c)
+            return false;
+        c->begin = c->end = DEQUE_SLOTS;
+        c->prev = NULL;
+        c->next = d->first;
+        if (d->first)
+            d->first->prev = c;
+        else
+            d->last = c;
+        d->first = c;
+    }
+    c->slot[--c->begin] = item;
+    d->size++;
+    return true;
+}
+
+bool deque_push_back(deque_t *d, void *item)
+{
+    deque_chunk_t *c = d->last;
+    if (!c || c->end == DEQUE_SLOTS) {
+        c = chunk_get(d);
+        if (!c)
+            return false;
+        c->begin = c->end = 0;
+        c->next = NULL;
+        c->prev = d->last;
+        if (d->last)
+            d->last->next = c;
+        else
+            d->first = c;
+        d->last = c;
+    }
+    c->slot[c->end++] = item;
+    d->size++;
+    return true;
+}
+
+/* Unlink @c from the chunks of @d and give it back */
+static void chunk_unlink(deque_t *d, deque_chunk_t *c)
+{
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        d->first = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+    else
+        d->last = c->prev;
+    chunk_put(d, c);
+}
+
+void *deque_pop_front(deque_t *d)
+{
+    deque_chunk_t *c = d->first;
+    if (!c)
+        return NULL;
+    void *item = c->slot[c->begin++];
+    if (c->begin == c->end)
+        chunk_unlink(d, c);
+    d->size--;
+    return item;
+}
+
+void *deque_pop_back(deque_t *d)
+{
+    deque_chunk_t *c = d->last;
+    if (!c)
+        return NULL;
+    void *item = c->slot[--c->end];
+    if (c->begin == c->end)
+        chunk_unlink(d, c);
+    d->size--;
+    return item;
+}
+
+void *deque_remove_at(deque_t *d, size_t i)
+{
+    deque_chunk_t *c;
+    if (i < d->size - i) {
+        for (c = d->first; i >= (size_t) (c->end - c->begin); c = c->next)
+            i -= c->end - c->begin;
+    } else {
+        /* Count from the back, then turn it into an index within @c */
+        size_t j = d->size - 1 - i;
+        for (c = d->last; j >= (size_t) (c->end - c->begin); c = c->prev)
+            j -= c->end - c->begin;
+        i = c->end - c->begin - 1 - j;
+    }
+
+    /* Close the gap from whichever side of the chunk has fewer items */
+    size_t at = c->begin + i;
+    void *item = c->slot[at];
+    if (i < (size_t) (c->end - c->begin) / 2) {
+        memmove(&c->slot[c->begin + 1], &c->slot[c->begin],
+                i * sizeof(void *));
+        c->begin++;
+    } else {
+        memmove(&c->slot[at], &c->slot[at + 1],
+                (c->end - at - 1) * sizeof(void *));
+        c->end--;
+    }
+    if (c->begin == c->end)
+        chunk_unlink(d, c);
+    d->size--;
+    return item;
+}
+
+void deque_reverse(deque_t *d)
+{
+    deque_chunk_t *c = d->first;
+    while (c) {
+        deque_chunk_t *next = c->next;
+        c->next = c->prev;
+        c->prev = next;
+
+        for (int i = c->begin, j = c->end - 1; i < j; i++, j--) {
+            void *tmp = c->slot[i];
+            c->slot[i] = c->slot[j];
+            c->slot[j] = tmp;
+        }
+        c = next;
+    }
+    c = d->first;
+    d->first = d->last;
+    d->last = c;
+}
+
+void deque_clear(deque_t *d)
+{
+    if (d->last) {
+        d->last->next = d->spare;
+        d->spare = d->first;
+    }
+    d->first = d->last = NULL;
+    d->size = 0;
+}
+
+void deque_take_chunks(deque_t *d, deque_t *from)
+{
+    deque_clear(from);
+    while (from->spare) {
+        deque_chunk_t *c = from->spare;
+        from->spare = c->next;
+        c->next = d->spare;
+        d->spare = c;
+    }
+    d->chunks += from->chunks;
+    from->chunks = 0;
+}
@@ -0,0 +1,130 @@
+#ifndef LAB0_DEQUE_H
+#define LAB0_DEQUE_H
+
+/* Double-ended queue of pointers kept in an unrolled linked list.
+ *
+ * Every chunk is aligned to a cache line and spans four of them, holding up to
+ * DEQUE_SLOTS consecutive pointers, 29 with 8-byte pointers. Walking the deque
+ * thus costs four cache misses per 29 items instead of one per item. Pushing
+ * and popping at either end is O(1).
+ *
+ * Chunks emptied by deque_clear() are kept as spares, so that filling the
+ * deque again with no more items than it had does not allocate.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DEQUE_CACHE_LINE 64
+
+/* A chunk of a single cache line is not worth the cost of its allocation */
+#define DEQUE_CHUNK_SIZE (4 * DEQUE_CACHE_LINE)
+
+#define DEQUE_SLOTS \
+    ((DEQUE_CHUNK_SIZE - 2 * sizeof(void *) - sizeof(int)) / sizeof(void *))
+
+/**
+ * deque_chunk_t - Chunk of a deque
+ * @prev: chunk holding the items before these, NULL for the first chunk
+ * @next: chunk holding the items after these, NULL for the last chunk
+ * @begin: first occupied slot
+ * @end: one past the last occupied slot
+ * @slot: the items, in order, in @slot[@begin] to @slot[@end - 1]
+ *
+ * A chunk in the deque holds at least one item.
+ */
+typedef struct deque_chunk {
+    struct deque_chunk *prev, *next;
+    unsigned short begin, end;
+    void *slot[DEQUE_SLOTS];
+} deque_chunk_t;
+
+/**
+ * deque_t - Deque of pointers
+ * @first: first chunk, NULL if the deque is empty
+ * @last: last chunk, NULL if the deque is empty
+ * @spare: chunks not in use, linked through ->next
+ * @size: number of items
+ * @chunks: number of chunks allocated, spares included
+ */
+typedef struct {
+    deque_chunk_t *first, *last;
+    deque_chunk_t *spare;
+    size_t size;
+    size_t chunks;
+} deque_t;
+
+/**
+ * deque_for_each() - Iterate over the items of a deque, from first to last
+ * @c: deque_chunk_t pointer to the chunk holding the item
+ * @i: int, index of the item in @c->slot
+ * @d: the deque
+ */
+#define deque_for_each(c, i, d)                 \
+    for (c = (d)->first; c; c = c->next)        \
+        for (i = c->begin; i < c->end; i++)
+
+/* Initialize an empty deque */
+void deque_init(deque_t *d);
+
+/* Free all chunks of @d, which is left empty. The items are not touched. */
+void deque_destroy(deque_t *d);
+
+/**
+ * deque_push_front() - Insert an item before the first one
+ * @d: deque to insert into
+ * @item: pointer to store
+ *
+ * Return: false if a chunk was needed and could not be allocated
+ */
+bool deque_push_front(deque_t *d, void *item);
+
+/**
+ * deque_push_back() - Insert an item after the last one
+ * @d: deque to insert into
+ * @item: pointer to store
+ *
+ * Return: false if a chunk was needed and could not be allocated
+ */
+bool deque_push_back(deque_t *d, void *item);
+
+/* Remove and return the first item, NULL if @d is empty */
+void *deque_pop_front(deque_t *d);
+
+/* Remove and return the last item, NULL if @d is empty */
+void *deque_pop_back(deque_t *d);
+
+/* Return the first item, NULL if @d is empty */
+static inline void *deque_front(const deque_t *d)
+{
+    return d->first ? d->first->slot[d->first->begin] : NULL;
+}
+
+/* Return the last item, NULL if @d is empty */
+static inline void *deque_back(const deque_t *d)
+{
+    return d->last ? d->last->slot[d->last->end - 1] : NULL;
+}
+
+/**
+ * deque_remove_at() - Remove an item from the middle of a deque
+ * @d: deque to remove from
+ * @i: index of the item, less than @d->size
+ *
+ * The chunk holding the item is found from the closer end, and only the items
+ * of that chunk move.
+ *
+ * Return: the removed item
+ */
+void *deque_remove_at(deque_t *d, size_t i);
+
+/* Reverse the order of the items in @d without moving them between chunks */
+void deque_reverse(deque_t *d);
+
+/* Empty @d, keeping its chunks as spares */
+void deque_clear(deque_t *d);
+
+/* Empty @from and move all its chunks to the spares of @d */
+void deque_take_chunks(deque_t *d, deque_t *from);
+
+#endif /* LAB0_DEQUE_H */
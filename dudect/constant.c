@@ -73,7 +73,8 @@ bool measure(int64_t *before_ticks,
              int mode)
 {
     assert(mode == DUT(insert_head) || mode == DUT(insert_tail) ||
-           mode == DUT(remove_head) || mode == DUT(remove_tail));
+           mode == DUT(remove_head) || mode == DUT(remove_tail) ||
+           mode == DUT(size));
 
     switch (mode) {
     case DUT(insert_head):
@@ -146,7 +147,7 @@ bool measure(int64_t *before_ticks,
                 return false;
         }
         break;
-    default:
+    case DUT(size):
         for (size_t i = DROP_SIZE; i < N_MEASURES - DROP_SIZE; i++) {
             dut_new();
             dut_insert_head(
@@ -1,10 +1,16 @@
 /* Test support code */
 
+#include <errno.h>
+#include <execinfo.h>
+#include <sched.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "report.h"
@@ -29,26 +35,72 @@
 
 /* Data structures used by our code */
 
-/* Represent allocated blocks as doubly-linked list, with
- * next and prev pointers at beginning
- */
+/* Header placed in front of every payload handed out */
 typedef struct __block_element {
-    struct __block_element *next, *prev;
     size_t payload_size;
-    size_t magic_header; /* Marker to see if block seems legitimate */
+    uint32_t magic_header; /* Marker to see if block seems legitimate */
+    uint8_t shard;         /* Index of the shard tracking the block */
+    uint8_t profiled;      /* Is a block_profile_t placed before the header? */
+    uint16_t offset; /* Distance from the start of the underlying allocation,
+                      * in units of BLOCK_ALIGN */
     unsigned char payload[0];
     /* Also place magic number at tail of every block */
 } block_element_t;
 
-static block_element_t *allocated = NULL;
-static size_t allocated_count = 0;
+/* Alignment the C library allocator guarantees, which the header preserves */
+#define BLOCK_ALIGN 16
+
+/* Largest alignment an offset in the header can express, with room left for
+ * a profile record
+ */
+#define MAX_ALIGN ((size_t) BLOCK_ALIGN << 15)
+
+_Static_assert(MAX_ALIGN == HARNESS_MAX_ALIGN,
+               "harness.h must tell the largest alignment accepted");
+
+/* Record kept in front of the header of blocks allocated in profiling mode */
+typedef struct {
+    alloc_site_t *site; /* statistics of the allocating call site */
+    uint64_t birth;     /* time of allocation in nanoseconds */
+} block_profile_t;
+
+_Static_assert(sizeof(block_profile_t) % BLOCK_ALIGN == 0,
+               "profile record must preserve the payload alignment");
+
+/* Allocated blocks are tracked in shards, one per thread as long as there
+ * are no more than N_SHARDS threads. A block stays with the shard of the
+ * thread that allocated it, and a lock per shard covers frees from other
+ * threads. Within a shard, blocks are kept in an open-addressing hash set
+ * with linear probing, so that a free can be validated in constant time.
+ * The table is at most half full.
+ */
+typedef struct {
+    atomic_flag lock;
+    block_element_t **blocks;
+    size_t cap;
+    size_t count;
+    alloc_site_t *sites; /* PROFILE_SITES call sites, plus one for the rest */
+} __attribute__((aligned(64))) shard_t;
+
+#define N_SHARDS 64
+#define SHARD_MIN_CAP 1024
+
+/* Call sites each shard can tell apart when profiling */
+#define PROFILE_SITES 256
+
+static shard_t shards[N_SHARDS] = {
+    [0 ... N_SHARDS - 1] = {.lock = ATOMIC_FLAG_INIT},
+};
+static atomic_uint next_shard = 0;
+static __thread int thread_shard = -1;
 
 /* Percent probability of malloc failure */
 int fail_probability = 0;
 
-static bool cautious_mode = true;
-static bool noallocate_mode = false;
-static bool error_occurred = false;
+static atomic_bool cautious_mode = true;
+static atomic_bool noallocate_mode = false;
+static atomic_bool profile_mode = false;
+static atomic_bool error_occurred = false;
 static char *error_message = "";
 
 static int time_limit = 1;
@@ -60,11 +112,363 @@ static bool time_limited = false;
 
 /* Internal functions */
 
-/* Should this allocation fail? */
-static bool fail_allocation()
+/* Seed of the allocation failures, and a count of the times it was set so
+ * that every thread restarts its sequence
+ */
+static uint64_t fail_seed = 0;
+static atomic_uint fail_generation = 1;
+
+/* Allocations left until the one set_fail_nth() asked to fail, 0 for none */
+static atomic_long fail_countdown = 0;
+
+/* Call sites set_fail_site() asked to fail, with a cache of the decision
+ * taken for every site seen so far
+ */
+#define FAIL_SITES 256
+static char fail_site_name[64] = "";
+static struct {
+    const void *site;
+    bool fail;
+} fail_sites[FAIL_SITES];
+static size_t n_fail_sites = 0;
+static atomic_flag fail_sites_lock = ATOMIC_FLAG_INIT;
+
+/* Are failures scheduled besides the random ones? */
+static atomic_bool fail_scheduled = false;
+
+/* Has set_fail_site() named a site? */
+static atomic_bool fail_site_set = false;
+
+static uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static int get_shard();
+
+/* Return addresses seen so far, and whether each lies within a function that
+ * has an exported symbol
+ */
+#define NAMED_SITES 512
+static struct {
+    const void *site;
+    bool named;
+} named_sites[NAMED_SITES];
+static atomic_flag named_sites_lock = ATOMIC_FLAG_INIT;
+
+/* Frames searched for a named caller */
+#define CALLER_DEPTH 16
+
+/* Is @site within a function backtrace_symbols() can name? Static functions
+ * have no exported symbol and only come out as an offset in their module.
+ */
+static bool site_named(const void *site)
+{
+    size_t i = ((uintptr_t) site >> 2) % NAMED_SITES;
+    while (atomic_flag_test_and_set_explicit(&named_sites_lock,
+                                             memory_order_acquire))
+        sched_yield();
+    for (size_t n = 0; n < NAMED_SITES && named_sites[i].site; n++) {
+        if (named_sites[i].site == site) {
+            bool named = named_sites[i].named;
+            atomic_flag_clear_explicit(&named_sites_lock,
+                                       memory_order_release);
+            return named;
+        }
+        i = (i + 1) % NAMED_SITES;
+    }
+    atomic_flag_clear_explicit(&named_sites_lock, memory_order_release);
+
+    void *addr = (void *) site;
+    char **sym = backtrace_symbols(&addr, 1);
+    const char *open = sym ? strchr(sym[0], '(') : NULL;
+    bool named = open && open[1] != '+' && open[1] != ')';
+    free(sym);
+
+    while (atomic_flag_test_and_set_explicit(&named_sites_lock,
+                                             memory_order_acquire))
+        sched_yield();
+    i = ((uintptr_t) site >> 2) % NAMED_SITES;
+    for (size_t n = 0; n < NAMED_SITES; n++) {
+        if (!named_sites[i].site) {
+            named_sites[i].site = site;
+            named_sites[i].named = named;
+            break;
+        }
+        if (named_sites[i].site == site)
+            break;
+        i = (i + 1) % NAMED_SITES;
+    }
+    atomic_flag_clear_explicit(&named_sites_lock, memory_order_release);
+    return named;
+}
+
+/* Return the call site to account an allocation made at @site to: @site
+ * itself when it is within a named function, else the call made by the first
+ * named function up the stack. Elements are allocated by static helpers such
+ * as element_new(), and what matters is the queue operation calling them.
+ */
+static const void *public_site(const void *site)
+{
+    if (!site || site_named(site))
+        return site;
+
+    void *frames[CALLER_DEPTH];
+    int n = backtrace(frames, CALLER_DEPTH);
+    int i = 0;
+    while (i < n && frames[i] != site)
+        i++;
+    for (i++; i < n; i++) {
+        if (site_named(frames[i]))
+            return frames[i];
+    }
+    return site;
+}
+
+/* Does @site, as public_site() gives it, match the name given to
+ * set_fail_site()?
+ */
+static bool fail_site(const void *site)
+{
+    while (atomic_flag_test_and_set_explicit(&fail_sites_lock,
+                                             memory_order_acquire))
+        sched_yield();
+
+    size_t i = 0;
+    while (i < n_fail_sites && fail_sites[i].site != site)
+        i++;
+    bool fail = false;
+    if (!fail_site_name[0]) {
+        /* No site to fail */
+    } else if (i < n_fail_sites) {
+        fail = fail_sites[i].fail;
+    } else {
+        char name[sizeof(fail_site_name) + 32];
+        size_t len = strlen(fail_site_name);
+        alloc_site_name(site, name, sizeof(name));
+        /* Either the exact site, or any site within a named function */
+        fail = !strncmp(name, fail_site_name, len) &&
+               (name[len] == '\0' || name[len] == '+');
+        if (n_fail_sites < FAIL_SITES) {
+            fail_sites[n_fail_sites].site = site;
+            fail_sites[n_fail_sites++].fail = fail;
+        }
+    }
+
+    atomic_flag_clear_explicit(&fail_sites_lock, memory_order_release);
+    return fail;
+}
+
+/* Should this allocation, made from @site, fail? Random failures come from a
+ * xorshift generator per thread, seeded from fail_seed and the order in which
+ * threads first allocated, so that a run can be repeated.
+ */
+static bool fail_allocation(const void *site)
+{
+    if (atomic_load_explicit(&fail_scheduled, memory_order_relaxed)) {
+        if (atomic_load(&fail_countdown) > 0 &&
+            atomic_fetch_sub(&fail_countdown, 1) == 1)
+            return true;
+        if (atomic_load_explicit(&fail_site_set, memory_order_relaxed) &&
+            fail_site(public_site(site)))
+            return true;
+    }
+
+    if (!fail_probability)
+        return false;
+
+    static __thread uint64_t state;
+    static __thread unsigned generation = 0;
+    unsigned current = atomic_load_explicit(&fail_generation,
+                                            memory_order_relaxed);
+    if (generation != current) {
+        generation = current;
+        state = splitmix64(fail_seed + get_shard()) | 1;
+    }
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    /* Scale the upper 32 bits into [0, 100) */
+    return ((state >> 32) * 100) >> 32 < (uint64_t) fail_probability;
+}
+
+/* Shards are rarely contended, as most blocks are freed by the thread that
+ * allocated them, so a spinlock that yields the CPU is enough.
+ */
+static void shard_lock(shard_t *shard)
+{
+    while (atomic_flag_test_and_set_explicit(&shard->lock,
+                                             memory_order_acquire))
+        sched_yield();
+}
+
+static void shard_unlock(shard_t *shard)
+{
+    atomic_flag_clear_explicit(&shard->lock, memory_order_release);
+}
+
+static int get_shard()
+{
+    if (thread_shard < 0)
+        thread_shard = atomic_fetch_add(&next_shard, 1) % N_SHARDS;
+    return thread_shard;
+}
+
+static size_t block_hash(const shard_t *shard, const block_element_t *b)
 {
-    double weight = (double) random() / RAND_MAX;
-    return (weight < 0.01 * fail_probability);
+    uint64_t h = (uintptr_t) b;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h & (shard->cap - 1);
+}
+
+/* Return the slot holding @b, or the empty slot ending its probe sequence */
+static size_t block_slot(const shard_t *shard, const block_element_t *b)
+{
+    size_t i = block_hash(shard, b);
+    while (shard->blocks[i] && shard->blocks[i] != b)
+        i = (i + 1) & (shard->cap - 1);
+    return i;
+}
+
+/* The caller holds the lock of @shard */
+static void block_track(shard_t *shard, block_element_t *b)
+{
+    if (2 * (shard->count + 1) > shard->cap) {
+        block_element_t **old = shard->blocks;
+        size_t old_cap = shard->cap;
+        shard->cap = old_cap ? 2 * old_cap : SHARD_MIN_CAP;
+        shard->blocks = calloc(shard->cap, sizeof(block_element_t *));
+        if (!shard->blocks) {
+            report_event(MSG_FATAL, "Couldn't allocate any more memory");
+            return;
+        }
+        for (size_t i = 0; i < old_cap; i++) {
+            if (old[i])
+                shard->blocks[block_slot(shard, old[i])] = old[i];
+        }
+        free(old);
+    }
+    shard->blocks[block_slot(shard, b)] = b;
+    shard->count++;
+}
+
+/* Remove @b from @shard, return false if it was not there. The caller holds
+ * the lock of @shard.
+ */
+static bool block_untrack(shard_t *shard, const block_element_t *b)
+{
+    if (!shard->cap)
+        return false;
+    size_t mask = shard->cap - 1;
+    size_t i = block_slot(shard, b);
+    if (!shard->blocks[i])
+        return false;
+
+    /* Shift later members of the probe sequence back into the hole, so that
+     * lookups never need tombstones.
+     */
+    for (size_t j = (i + 1) & mask; shard->blocks[j]; j = (j + 1) & mask) {
+        size_t home = block_hash(shard, shard->blocks[j]);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            shard->blocks[i] = shard->blocks[j];
+            i = j;
+        }
+    }
+    shard->blocks[i] = NULL;
+    shard->count--;
+    return true;
+}
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Find or add the statistics of @site in @shard, falling back to a shared
+ * entry once the table is full. The caller holds the lock of @shard.
+ */
+static alloc_site_t *profile_site(shard_t *shard, const void *site)
+{
+    if (!shard->sites) {
+        shard->sites = calloc(PROFILE_SITES + 1, sizeof(alloc_site_t));
+        if (!shard->sites)
+            return NULL;
+    }
+
+    size_t i = ((uintptr_t) site >> 2) % PROFILE_SITES;
+    for (size_t n = 0; n < PROFILE_SITES; n++) {
+        alloc_site_t *s = &shard->sites[i];
+        if (s->site == site)
+            return s;
+        if (!s->site) {
+            s->site = site;
+            return s;
+        }
+        i = (i + 1) % PROFILE_SITES;
+    }
+    return &shard->sites[PROFILE_SITES];
+}
+
+/* Account allocated block @b to @site. The caller holds the lock of @shard. */
+static void profile_alloc(shard_t *shard, block_element_t *b, const void *site)
+{
+    block_profile_t *prof = (block_profile_t *) b - 1;
+    alloc_site_t *s = profile_site(shard, site);
+    prof->site = s;
+    prof->birth = now_ns();
+    if (!s)
+        return;
+    s->allocs++;
+    s->bytes += b->payload_size;
+    s->live_bytes += b->payload_size;
+    if (s->live_bytes > s->peak_bytes)
+        s->peak_bytes = s->live_bytes;
+}
+
+/* Account the release of @b, with the lock of its shard held */
+static void profile_free(const block_element_t *b)
+{
+    const block_profile_t *prof = (const block_profile_t *) b - 1;
+    alloc_site_t *s = prof->site;
+    if (!s)
+        return;
+
+    uint64_t lifetime = now_ns() - prof->birth;
+    uint64_t limit = 1000;
+    int bucket = 0;
+    while (bucket < PROFILE_BUCKETS - 1 && lifetime >= limit) {
+        limit *= 10;
+        bucket++;
+    }
+    s->lifetime[bucket]++;
+    s->live_bytes -= b->payload_size;
+}
+
+/* The shard @b claims to belong to, NULL if that cannot be right */
+static shard_t *block_shard(const block_element_t *b)
+{
+    return b->shard < N_SHARDS ? &shards[b->shard] : NULL;
+}
+
+/* Take @b out of the shard tracking it, return false if it was not there */
+static bool block_release(const block_element_t *b)
+{
+    shard_t *shard = block_shard(b);
+    if (!shard)
+        return false;
+    shard_lock(shard);
+    bool found = block_untrack(shard, b);
+    if (found && b->profiled)
+        profile_free(b);
+    shard_unlock(shard);
+    return found;
 }
 
 /* Find header of block, given its payload.
@@ -79,22 +483,6 @@ static block_element_t *find_header(void *p)
 
     block_element_t *b =
         (block_element_t *) ((size_t) p - sizeof(block_element_t));
-    if (cautious_mode) {
-        /* Make sure this is really an allocated block */
-        block_element_t *ab = allocated;
-        bool found = false;
-        while (ab && !found) {
-            found = ab == b;
-            ab = ab->next;
-        }
-        if (!found) {
-            report_event(MSG_ERROR,
-                         "Attempted to free unallocated block.  Address = %p",
-                         p);
-            error_occurred = true;
-        }
-    }
-
     if (b->magic_header != MAGICHEADER) {
         report_event(
             MSG_ERROR,
@@ -117,45 +505,82 @@ static size_t *find_footer(block_element_t *b)
 
 /* Implementation of application functions */
 
-void *test_malloc(size_t size)
+/* Reject the calls a real allocator would not get to see */
+static bool allocation_refused(const char *fn, const void *site)
 {
     if (noallocate_mode) {
-        report_event(MSG_FATAL, "Calls to malloc disallowed");
-        return NULL;
+        report_event(MSG_FATAL, "Calls to %s disallowed", fn);
+        return true;
     }
 
-    if (fail_allocation()) {
-        report_event(MSG_WARN, "Malloc returning NULL");
+    if (fail_allocation(site)) {
+        report_event(MSG_WARN, "%s returning NULL", fn);
+        return true;
+    }
+    return false;
+}
+
+/* Allocate and track a block whose payload is aligned to @alignment, which
+ * is a power of two. Alignments up to BLOCK_ALIGN come for free, larger ones
+ * are reached by allocating more and moving the header forward. In profiling
+ * mode, the block is accounted to @site.
+ */
+static void *block_new(size_t size, size_t alignment, const void *site)
+{
+    bool profiled = profile_mode;
+    size_t front =
+        sizeof(block_element_t) + (profiled ? sizeof(block_profile_t) : 0);
+    size_t slack = alignment > BLOCK_ALIGN ? alignment - BLOCK_ALIGN : 0;
+    size_t overhead = front + sizeof(size_t) + slack;
+    if (size > SIZE_MAX - overhead) {
+        report_event(MSG_WARN, "Allocation of %zu bytes is too large", size);
         return NULL;
     }
 
-    block_element_t *new_block =
-        malloc(size + sizeof(block_element_t) + sizeof(size_t));
-    if (!new_block) {
+    unsigned char *base = malloc(size + overhead);
+    if (!base) {
         report_event(MSG_FATAL, "Couldn't allocate any more memory");
         error_occurred = true;
+        return NULL;
     }
 
-    // cppcheck-suppress nullPointerRedundantCheck
+    size_t payload = ((size_t) base + front + alignment - 1) & ~(alignment - 1);
+    block_element_t *new_block =
+        (block_element_t *) (payload - sizeof(block_element_t));
     new_block->magic_header = MAGICHEADER;
-    // cppcheck-suppress nullPointerRedundantCheck
     new_block->payload_size = size;
+    new_block->profiled = profiled;
+    new_block->offset = ((unsigned char *) new_block - base) / BLOCK_ALIGN;
     *find_footer(new_block) = MAGICFOOTER;
     void *p = (void *) &new_block->payload;
     memset(p, FILLCHAR, size);
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->next = allocated;
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->prev = NULL;
 
-    if (allocated)
-        allocated->prev = new_block;
-    allocated = new_block;
-    allocated_count++;
+    if (profiled)
+        site = public_site(site);
+    int id = get_shard();
+    new_block->shard = id;
+    shard_lock(&shards[id]);
+    block_track(&shards[id], new_block);
+    if (profiled)
+        profile_alloc(&shards[id], new_block, site);
+    shard_unlock(&shards[id]);
 
     return p;
 }
 
+/* test_malloc on behalf of the caller at @site */
+static void *malloc_at(size_t size, const void *site)
+{
+    if (allocation_refused("malloc", site))
+        return NULL;
+    return block_new(size, 1, site);
+}
+
+void *test_malloc(size_t size)
+{
+    return malloc_at(size, __builtin_return_address(0));
+}
+
 // cppcheck-suppress unusedFunction
 void *test_calloc(size_t nelem, size_t elsize)
 {
@@ -163,8 +588,9 @@ void *test_calloc(size_t nelem, size_t elsize)
      * https://danluu.com/malloc-tutorial/
      */
     size_t size = nelem * elsize;  // TODO: check for overflow
-    void *ptr = test_malloc(size);
-    memset(ptr, 0, size);
+    void *ptr = malloc_at(size, __builtin_return_address(0));
+    if (ptr)
+        memset(ptr, 0, size);
     return ptr;
 }
 
@@ -179,6 +605,14 @@ void test_free(void *p)
         return;
 
     block_element_t *b = find_header(p);
+    /* The lookup needed to stop tracking the block also tells whether it is
+     * really allocated, but only cautious mode reports that.
+     */
+    if (!block_release(b) && cautious_mode) {
+        report_event(MSG_ERROR,
+                     "Attempted to free unallocated block.  Address = %p", p);
+        error_occurred = true;
+    }
     size_t footer = *find_footer(b);
     if (footer != MAGICFOOTER) {
         report_event(MSG_ERROR,
@@ -191,25 +625,84 @@ void test_free(void *p)
     *find_footer(b) = MAGICFREE;
     memset(p, FILLCHAR, b->payload_size);
 
-    /* Unlink from list */
-    block_element_t *bn = b->next;
-    block_element_t *bp = b->prev;
-    if (bp)
-        bp->next = bn;
-    else
-        allocated = bn;
-    if (bn)
-        bn->prev = bp;
+    free((unsigned char *) b - (size_t) b->offset * BLOCK_ALIGN);
+}
+
+// cppcheck-suppress unusedFunction
+void *test_realloc(void *p, size_t size)
+{
+    if (!p)
+        return malloc_at(size, __builtin_return_address(0));
+
+    if (size == 0) {
+        test_free(p);
+        return NULL;
+    }
+
+    if (allocation_refused("realloc", __builtin_return_address(0)))
+        return NULL;
+
+    /* Catch a bogus block before its size is trusted */
+    block_element_t *b =
+        (block_element_t *) ((size_t) p - sizeof(block_element_t));
+    if (b->magic_header != MAGICHEADER || *find_footer(b) != MAGICFOOTER) {
+        report_event(MSG_ERROR,
+                     "Attempted to reallocate unallocated or corrupted block. "
+                     " Address = %p",
+                     p);
+        error_occurred = true;
+        return NULL;
+    }
+
+    void *new = block_new(size, 1, __builtin_return_address(0));
+    if (!new)
+        return NULL;
+    memcpy(new, p, b->payload_size < size ? b->payload_size : size);
+    test_free(p);
+    return new;
+}
+
+// cppcheck-suppress unusedFunction
+void *test_aligned_alloc(size_t alignment, size_t size)
+{
+    if (!alignment || (alignment & (alignment - 1)) || alignment > MAX_ALIGN) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (allocation_refused("aligned_alloc", __builtin_return_address(0))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *p = block_new(size, alignment, __builtin_return_address(0));
+    if (!p)
+        errno = ENOMEM;
+    return p;
+}
+
+// cppcheck-suppress unusedFunction
+int test_posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    if (!alignment || alignment % sizeof(void *) ||
+        (alignment & (alignment - 1)) || alignment > MAX_ALIGN)
+        return EINVAL;
+
+    if (allocation_refused("posix_memalign", __builtin_return_address(0)))
+        return ENOMEM;
 
-    free(b);
-    allocated_count--;
+    void *p = block_new(size, alignment, __builtin_return_address(0));
+    if (!p)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
 }
 
 // cppcheck-suppress unusedFunction
 char *test_strdup(const char *s)
 {
     size_t len = strlen(s) + 1;
-    void *new = test_malloc(len);
+    void *new = malloc_at(len, __builtin_return_address(0));
     if (!new)
         return NULL;
 
@@ -218,7 +711,61 @@ char *test_strdup(const char *s)
 
 size_t allocation_check()
 {
-    return allocated_count;
+    size_t count = 0;
+    for (int i = 0; i < N_SHARDS; i++) {
+        shard_lock(&shards[i]);
+        count += shards[i].count;
+        shard_unlock(&shards[i]);
+    }
+    return count;
+}
+
+size_t profile_sites(alloc_site_t *sites, size_t max)
+{
+    size_t n = 0;
+    for (int i = 0; i < N_SHARDS; i++) {
+        shard_t *shard = &shards[i];
+        shard_lock(shard);
+        for (size_t j = 0; shard->sites && j <= PROFILE_SITES; j++) {
+            const alloc_site_t *s = &shard->sites[j];
+            if (!s->allocs && !s->live_bytes)
+                continue;
+            /* Sites are few, a linear search merges them well enough */
+            size_t k = 0;
+            while (k < n && sites[k].site != s->site)
+                k++;
+            if (k == n) {
+                if (n == max)
+                    continue;
+                memset(&sites[n++], 0, sizeof(alloc_site_t));
+                sites[k].site = s->site;
+            }
+            sites[k].allocs += s->allocs;
+            sites[k].bytes += s->bytes;
+            sites[k].live_bytes += s->live_bytes;
+            sites[k].peak_bytes += s->peak_bytes;
+            for (int b = 0; b < PROFILE_BUCKETS; b++)
+                sites[k].lifetime[b] += s->lifetime[b];
+        }
+        shard_unlock(shard);
+    }
+    return n;
+}
+
+void profile_reset()
+{
+    for (int i = 0; i < N_SHARDS; i++) {
+        shard_t *shard = &shards[i];
+        shard_lock(shard);
+        for (size_t j = 0; shard->sites && j <= PROFILE_SITES; j++) {
+            alloc_site_t *s = &shard->sites[j];
+            s->allocs = 0;
+            s->bytes = 0;
+            s->peak_bytes = s->live_bytes;
+            memset(s->lifetime, 0, sizeof(s->lifetime));
+        }
+        shard_unlock(shard);
+    }
 }
 
 /* Implementation of functions for testing */
@@ -239,12 +786,75 @@ void set_noallocate_mode(bool noallocate)
     noallocate_mode = noallocate;
 }
 
+void set_profile_mode(bool profile)
+{
+    profile_mode = profile;
+}
+
+void set_fail_seed(unsigned seed)
+{
+    fail_seed = seed;
+    atomic_fetch_add(&fail_generation, 1);
+}
+
+static void update_fail_scheduled()
+{
+    fail_scheduled = atomic_load(&fail_countdown) > 0 || fail_site_name[0];
+}
+
+void set_fail_nth(long n)
+{
+    fail_countdown = n > 0 ? n : 0;
+    update_fail_scheduled();
+}
+
+void set_fail_site(const char *name)
+{
+    while (atomic_flag_test_and_set_explicit(&fail_sites_lock,
+                                             memory_order_acquire))
+        sched_yield();
+    snprintf(fail_site_name, sizeof(fail_site_name), "%s", name ? name : "");
+    n_fail_sites = 0;
+    fail_site_set = fail_site_name[0];
+    atomic_flag_clear_explicit(&fail_sites_lock, memory_order_release);
+    update_fail_scheduled();
+}
+
+void alloc_site_name(const void *site, char *buf, size_t size)
+{
+    if (!site) {
+        snprintf(buf, size, "(other)");
+        return;
+    }
+
+    /* Entries look like "./qtest(q_insert_tail+0x2a) [0x55d4...]", or
+     * "./qtest(+0x39a6) [0x55d4...]" for static functions, an offset that
+     * addr2line(1) resolves.
+     */
+    void *addr = (void *) site;
+    char **sym = backtrace_symbols(&addr, 1);
+    const char *open = sym ? strchr(sym[0], '(') : NULL;
+    const char *close = open ? strchr(open, ')') : NULL;
+    if (!close || close == open + 1) {
+        snprintf(buf, size, "%p", site);
+    } else if (open[1] != '+') {
+        snprintf(buf, size, "%.*s", (int) (close - open - 1), open + 1);
+    } else {
+        const char *module = sym[0];
+        for (const char *c = sym[0]; c < open; c++) {
+            if (*c == '/')
+                module = c + 1;
+        }
+        snprintf(buf, size, "%.*s%.*s", (int) (open - module), module,
+                 (int) (close - open - 1), open + 1);
+    }
+    free(sym);
+}
+
 /* Return whether any errors have occurred since last time set error limit */
 bool error_check()
 {
-    bool e = error_occurred;
-    error_occurred = false;
-    return e;
+    return atomic_exchange(&error_occurred, false);
 }
 
 /* Prepare for a risky operation using setjmp.
@@ -14,7 +14,12 @@ void *test_malloc(size_t size);
 void *test_calloc(size_t nmemb, size_t size);
 void test_free(void *p);
 char *test_strdup(const char *s);
-/* FIXME: provide test_realloc as well */
+void *test_realloc(void *p, size_t size);
+void *test_aligned_alloc(size_t alignment, size_t size);
+int test_posix_memalign(void **memptr, size_t alignment, size_t size);
+
+/* Largest alignment test_aligned_alloc() and test_posix_memalign() accept */
+#define HARNESS_MAX_ALIGN ((size_t) 1 << 19)
 
 #ifdef INTERNAL
 
@@ -24,12 +29,61 @@ size_t allocation_check();
 /* Probability of malloc failing, expressed as percent */
 extern int fail_probability;
 
+/* Restart the sequence of random malloc failures from @seed */
+void set_fail_seed(unsigned seed);
+
+/* Fail the @n-th allocation from now on, none if @n is 0 */
+void set_fail_nth(long n);
+
+/* Fail every allocation made at call sites named @name, which is either a
+ * site as memstat shows it or a function name matching all sites within.
+ * Allocations from static functions are made on behalf of their first named
+ * caller, as memstat accounts them. NULL or "" fails none.
+ */
+void set_fail_site(const char *name);
+
+/* Describe call @site as "function+offset", or "module+offset" when the
+ * function has no exported symbol
+ */
+void alloc_site_name(const void *site, char *buf, size_t size);
+
 /*
  * Set/unset cautious mode.
  * In this mode, makes extra sure any block to be freed is currently allocated.
  */
 void set_cautious_mode(bool cautious);
 
+/*
+ * Set/unset profiling mode.
+ * In this mode, allocations are accounted to the code calling the allocator,
+ * or when that is a static function, to the call made by the first function
+ * with an exported symbol up the stack, so that memstat can name it.
+ */
+void set_profile_mode(bool profile);
+
+/* Buckets of a lifetime histogram. Bucket i counts blocks freed less than
+ * 10^i microseconds after being allocated, the last bucket all others.
+ */
+#define PROFILE_BUCKETS 8
+
+/* Allocation statistics of one call site */
+typedef struct {
+    const void *site; /* return address of that call, NULL for all others */
+    size_t allocs;
+    size_t bytes;
+    size_t live_bytes;
+    size_t peak_bytes; /* summed over threads allocating at this site */
+    size_t lifetime[PROFILE_BUCKETS];
+} alloc_site_t;
+
+/* Merge the statistics of each call site into @sites. Return the number of
+ * entries filled, sites past the first @max are left out.
+ */
+size_t profile_sites(alloc_site_t *sites, size_t max);
+
+/* Restart the statistics, keeping track of blocks still allocated */
+void profile_reset();
+
 /*
  * Set/unset restricted allocation mode.
  * In this mode, calls to malloc and free are disallowed.
@@ -56,6 +110,9 @@ void trigger_exception(char *msg);
 /* Tested program use our versions of malloc and free */
 #define malloc test_malloc
 #define free test_free
+#define realloc test_realloc
+#define aligned_alloc test_aligned_alloc
+#define posix_memalign test_posix_memalign
 
 /* Use undef to avoid strdup redefined error */
 #undef strdup
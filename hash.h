@@ -0,0 +1,108 @@
+#ifndef LAB0_HASH_H
+#define LAB0_HASH_H
+
+/* Fast non-cryptographic hashing, after wyhash by Wang Yi.
+ *
+ * Keys are consumed eight bytes at a time and mixed with 64x64->128 bit
+ * multiplications, which makes short strings cost only a few cycles.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static inline uint64_t hash_mix(uint64_t a, uint64_t b)
+{
+    __uint128_t r = (__uint128_t) a * b;
+    return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+static inline uint64_t hash_read8(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t hash_read4(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * hash_bytes() - Hash an array of bytes
+ * @key: bytes to hash
+ * @len: number of bytes in @key
+ * @seed: value selecting one of many hash functions
+ *
+ * Return: 64-bit hash value
+ */
+static inline uint64_t hash_bytes(const void *key, size_t len, uint64_t seed)
+{
+    static const uint64_t secret[4] = {
+        0xa0761d6478bd642fULL,
+        0xe7037ed1a0b428dbULL,
+        0x8ebc6af09c88c6e3ULL,
+        0x589965cc75374cc3ULL,
+    };
+    const uint8_t *p = key;
+    uint64_t a, b;
+
+    seed ^= hash_mix(seed ^ secret[0], secret[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t mid = (len >> 3) << 2;
+            a = hash_read4(p) << 32 | hash_read4(p + mid);
+            b = hash_read4(p + len - 4) << 32 | hash_read4(p + len - 4 - mid);
+        } else if (len > 0) {
+            a = (uint64_t) p[0] << 16 | (uint64_t) p[len >> 1] << 8 |
+                p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t seed1 = seed, seed2 = seed;
+            do {
+                seed = hash_mix(hash_read8(p) ^ secret[1],
+                                hash_read8(p + 8) ^ seed);
+                seed1 = hash_mix(hash_read8(p + 16) ^ secret[2],
+                                 hash_read8(p + 24) ^ seed1);
+                seed2 = hash_mix(hash_read8(p + 32) ^ secret[3],
+                                 hash_read8(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (i > 16) {
+            seed =
+                hash_mix(hash_read8(p) ^ secret[1], hash_read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = hash_read8(p + i - 16);
+        b = hash_read8(p + i - 8);
+    }
+
+    __uint128_t r = (__uint128_t) (a ^ secret[1]) * (b ^ seed);
+    return hash_mix((uint64_t) r ^ secret[0] ^ len,
+                    (uint64_t) (r >> 64) ^ secret[1]);
+}
+
+/**
+ * hash_string() - Hash a null-terminated string
+ * @s: string to hash
+ *
+ * Return: 64-bit hash value
+ */
+static inline uint64_t hash_string(const char *s)
+{
+    return hash_bytes(s, strlen(s), 0);
+}
+
+#endif /* LAB0_HASH_H */
@@ -0,0 +1,186 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "hash.h"
+#include "intern.h"
+
+/* Strings are carved from blocks of this size. A string taking more than a
+ * quarter of it gets a block of its own, so that little room is left over.
+ */
+#define INTERN_BLOCK_SIZE 16384
+
+/* Smallest hash index worth allocating */
+#define INTERN_INDEX_MIN 64
+
+typedef struct {
+    size_t used; /* bytes of @data handed out */
+    size_t live; /* strings in @data still referenced */
+    char data[];
+} intern_block_t;
+
+typedef struct {
+    intern_block_t *block;
+    uint64_t hash;
+    size_t refs;
+    char str[];
+} intern_str_t;
+
+/* Block new strings are carved from, NULL until the first one */
+static intern_block_t *cur_block = NULL;
+
+/* Hash index with linear probing, NULL marks an unused slot */
+static intern_str_t **index_slot = NULL;
+static size_t index_cap = 0;
+static size_t index_count = 0;
+
+static inline intern_str_t *to_entry(const char *s)
+{
+    return (intern_str_t *) (s - offsetof(intern_str_t, str));
+}
+
+/* Slot holding @s, or the unused slot where it belongs */
+static size_t index_find(const char *s, uint64_t hash)
+{
+    size_t mask = index_cap - 1;
+    size_t i = hash & mask;
+    while (index_slot[i] &&
+           (index_slot[i]->hash != hash || strcmp(index_slot[i]->str, s)))
+        i = (i + 1) & mask;
+    return i;
+}
+
+/* Double the index, keeping its load factor at or below one half */
+static bool index_grow()
+{
+    size_t cap = index_cap ? 2 * index_cap : INTERN_INDEX_MIN;
+    intern_str_t **slot = malloc(sizeof(intern_str_t *) * cap);
+    if (!slot)
+        return false;
+    memset(slot, 0, sizeof(intern_str_t *) * cap);
+
+    for (size_t i = 0; i < index_cap; i++) {
+        intern_str_t *e = index_slot[i];
+        if (!e)
+            continue;
+        size_t j = e->hash & (cap - 1);
+        while (slot[j])
+            j = (j + 1) & (cap - 1);
+        slot[j] = e;
+    }
+    free(index_slot);
+    index_slot = slot;
+    index_cap = cap;
+    return true;
+}
+
+/* Unlink the entry in slot @i, moving later entries of its probe sequence
+ * back so that no tombstone is needed
+ */
+static void index_remove(size_t i)
+{
+    size_t mask = index_cap - 1;
+    for (size_t j = (i + 1) & mask; index_slot[j]; j = (j + 1) & mask) {
+        size_t home = index_slot[j]->hash & mask;
+        /* The entry may move to @i unless its home lies in (i, j] */
+        bool stays =
+            i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            index_slot[i] = index_slot[j];
+            i = j;
+        }
+    }
+    index_slot[i] = NULL;
+
+    if (!--index_count) {
+        free(index_slot);
+        index_slot = NULL;
+        index_cap = 0;
+    }
+}
+
+/* Carve @size bytes for a new string out of the arena */
+static intern_str_t *arena_alloc(size_t size)
+{
+    intern_block_t *b = cur_block;
+    if (size > INTERN_BLOCK_SIZE / 4) {
+        b = malloc(sizeof(intern_block_t) + size);
+        if (!b)
+            return NULL;
+        b->used = b->live = 0;
+    } else if (!b || b->used + size > INTERN_BLOCK_SIZE) {
+        b = malloc(sizeof(intern_block_t) + INTERN_BLOCK_SIZE);
+        if (!b)
+            return NULL;
+        b->used = b->live = 0;
+        cur_block = b;
+    }
+
+    intern_str_t *e = (intern_str_t *) (b->data + b->used);
+    b->used += size;
+    b->live++;
+    e->block = b;
+    return e;
+}
+
+char *intern_get(const char *s, size_t len)
+{
+    uint64_t hash = hash_bytes(s, len, 0);
+    size_t i = 0;
+    if (index_cap) {
+        i = index_find(s, hash);
+        if (index_slot[i]) {
+            index_slot[i]->refs++;
+            return index_slot[i]->str;
+        }
+    }
+
+    if (2 * (index_count + 1) > index_cap) {
+        if (!index_grow())
+            return NULL;
+        i = index_find(s, hash);
+    }
+
+    /* Keep every entry aligned for its header */
+    size_t size = sizeof(intern_str_t) + len + 1;
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    intern_str_t *e = arena_alloc(size);
+    if (!e) {
+        /* The index may have just been allocated for this string */
+        if (!index_count) {
+            free(index_slot);
+            index_slot = NULL;
+            index_cap = 0;
+        }
+        return NULL;
+    }
+    e->hash = hash;
+    e->refs = 1;
+    memcpy(e->str, s, len + 1);
+    index_slot[i] = e;
+    index_count++;
+    return e->str;
+}
+
+void intern_put(char *s)
+{
+    intern_str_t *e = to_entry(s);
+    if (--e->refs)
+        return;
+
+    index_remove(index_find(s, e->hash));
+
+    intern_block_t *b = e->block;
+    if (--b->live)
+        return;
+    if (b == cur_block)
+        cur_block = NULL;
+    free(b);
+}
+
+size_t intern_count()
+{
+    return index_count;
+}
@@ -0,0 +1,35 @@
+#ifndef LAB0_INTERN_H
+#define LAB0_INTERN_H
+
+/* Interning of queue values.
+ *
+ * An interned string is stored once, however many elements hold it. The
+ * copies are carved from large arena blocks and found again through a hash
+ * index. Each copy counts its references and goes away with the last one; a
+ * block is freed once none of its strings is referenced.
+ *
+ * Interned strings are shared and must not be written to. Callers wanting
+ * their own copy get it from q_remove_head() and q_remove_tail() in @sp.
+ */
+
+#include <stddef.h>
+
+/**
+ * intern_get() - Take a reference to the interned copy of a string
+ * @s: string to intern
+ * @len: length of @s
+ *
+ * Return: the interned copy, NULL if it could not be allocated
+ */
+char *intern_get(const char *s, size_t len);
+
+/**
+ * intern_put() - Drop a reference taken by intern_get()
+ * @s: the interned copy
+ */
+void intern_put(char *s);
+
+/* Return the number of distinct strings interned */
+size_t intern_count();
+
+#endif /* LAB0_INTERN_H */
@@ -0,0 +1,267 @@
+/* Lock-free FIFO queue (Michael and Scott, PODC 1996) with hazard pointers
+ * (Michael, IEEE TPDS 2004) for memory reclamation.
+ *
+ * Nodes come from the harness allocator, which tolerates frees from threads
+ * other than the allocating one, so leaks and corruption are caught as for the
+ * other queues.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "lfq.h"
+
+/* Keep the contended pointers on separate cache lines */
+#define CACHE_LINE 64
+
+/* Hazard pointers each thread may publish */
+#define HP_PER_THREAD 2
+
+/* Retired nodes a thread accumulates before trying to free them */
+#define RETIRE_THRESHOLD (2 * HP_PER_THREAD * LFQ_MAX_THREADS)
+
+typedef struct lfq_node {
+    _Atomic(struct lfq_node *) next;
+    struct lfq_node *retired_next;
+    char value[];
+} lfq_node_t;
+
+typedef struct {
+    _Atomic(lfq_node_t *) hp[HP_PER_THREAD];
+    lfq_node_t *retired; /* only touched by the thread owning the slot */
+    size_t n_retired;
+} __attribute__((aligned(CACHE_LINE))) lfq_slot_t;
+
+struct lfq {
+    _Atomic(lfq_node_t *) head __attribute__((aligned(CACHE_LINE)));
+    _Atomic(lfq_node_t *) tail __attribute__((aligned(CACHE_LINE)));
+    atomic_size_t size __attribute__((aligned(CACHE_LINE)));
+    lfq_slot_t slots[LFQ_MAX_THREADS];
+};
+
+/* Every thread claims one slot index, valid for all queues, on first use and
+ * gives it back when it exits.
+ */
+static atomic_bool slot_taken[LFQ_MAX_THREADS];
+static __thread int thread_slot = -1;
+static pthread_key_t slot_key;
+static pthread_once_t slot_once = PTHREAD_ONCE_INIT;
+
+static void slot_release(void *arg)
+{
+    atomic_store(&slot_taken[(intptr_t) arg - 1], false);
+}
+
+static void slot_key_init(void)
+{
+    pthread_key_create(&slot_key, slot_release);
+}
+
+static int get_slot(void)
+{
+    if (thread_slot >= 0)
+        return thread_slot;
+
+    pthread_once(&slot_once, slot_key_init);
+    for (int i = 0; i < LFQ_MAX_THREADS; i++) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&slot_taken[i], &expected, true)) {
+            /* Store i + 1 since a NULL value skips the destructor */
+            pthread_setspecific(slot_key, (void *) (intptr_t) (i + 1));
+            thread_slot = i;
+            return i;
+        }
+    }
+    return -1;
+}
+
+static lfq_node_t *node_new(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    lfq_node_t *node = malloc(sizeof(lfq_node_t) + len);
+    if (!node)
+        return NULL;
+    atomic_init(&node->next, NULL);
+    node->retired_next = NULL;
+    memcpy(node->value, s, len);
+    return node;
+}
+
+lfq_t *lfq_new(void)
+{
+    lfq_t *q = aligned_alloc(CACHE_LINE, sizeof(lfq_t));
+    if (!q)
+        return NULL;
+    lfq_node_t *dummy = node_new("");
+    if (!dummy) {
+        free(q);
+        return NULL;
+    }
+
+    atomic_init(&q->head, dummy);
+    atomic_init(&q->tail, dummy);
+    atomic_init(&q->size, 0);
+    for (int i = 0; i < LFQ_MAX_THREADS; i++) {
+        for (int j = 0; j < HP_PER_THREAD; j++)
+            atomic_init(&q->slots[i].hp[j], NULL);
+        q->slots[i].retired = NULL;
+        q->slots[i].n_retired = 0;
+    }
+    return q;
+}
+
+void lfq_free(lfq_t *q)
+{
+    if (!q)
+        return;
+
+    lfq_node_t *node = atomic_load(&q->head);
+    while (node) {
+        lfq_node_t *next = atomic_load(&node->next);
+        free(node);
+        node = next;
+    }
+    for (int i = 0; i < LFQ_MAX_THREADS; i++) {
+        node = q->slots[i].retired;
+        while (node) {
+            lfq_node_t *next = node->retired_next;
+            free(node);
+            node = next;
+        }
+    }
+    free(q);
+}
+
+/* Publish @*src as hazardous in @hp and return it once it is known to have
+ * still been reachable after the publication.
+ */
+static lfq_node_t *protect(_Atomic(lfq_node_t *) *hp,
+                           _Atomic(lfq_node_t *) *src)
+{
+    lfq_node_t *node = atomic_load(src);
+    for (;;) {
+        atomic_store(hp, node);
+        lfq_node_t *again = atomic_load(src);
+        if (again == node)
+            return node;
+        node = again;
+    }
+}
+
+static bool is_hazardous(lfq_t *q, const lfq_node_t *node)
+{
+    for (int i = 0; i < LFQ_MAX_THREADS; i++) {
+        for (int j = 0; j < HP_PER_THREAD; j++) {
+            if (atomic_load(&q->slots[i].hp[j]) == node)
+                return true;
+        }
+    }
+    return false;
+}
+
+/* Defer freeing @node until no hazard pointer refers to it */
+static void retire(lfq_t *q, lfq_slot_t *slot, lfq_node_t *node)
+{
+    node->retired_next = slot->retired;
+    slot->retired = node;
+    if (++slot->n_retired < RETIRE_THRESHOLD)
+        return;
+
+    lfq_node_t **pp = &slot->retired;
+    while (*pp) {
+        lfq_node_t *cur = *pp;
+        if (is_hazardous(q, cur)) {
+            pp = &cur->retired_next;
+        } else {
+            *pp = cur->retired_next;
+            free(cur);
+            slot->n_retired--;
+        }
+    }
+}
+
+bool lfq_insert_tail(lfq_t *q, const char *s)
+{
+    int id = get_slot();
+    if (!q || id < 0)
+        return false;
+    lfq_node_t *node = node_new(s);
+    if (!node)
+        return false;
+
+    /* Count the node before it becomes visible, so that a consumer can never
+     * take the size below zero.
+     */
+    atomic_fetch_add(&q->size, 1);
+
+    lfq_slot_t *slot = &q->slots[id];
+    lfq_node_t *tail;
+    for (;;) {
+        tail = protect(&slot->hp[0], &q->tail);
+        lfq_node_t *next = atomic_load(&tail->next);
+        if (tail != atomic_load(&q->tail))
+            continue;
+        if (next) {
+            /* The tail is lagging behind, help to advance it */
+            atomic_compare_exchange_weak(&q->tail, &tail, next);
+            continue;
+        }
+        lfq_node_t *expected = NULL;
+        if (atomic_compare_exchange_weak(&tail->next, &expected, node))
+            break;
+    }
+    atomic_compare_exchange_strong(&q->tail, &tail, node);
+    atomic_store(&slot->hp[0], NULL);
+    return true;
+}
+
+bool lfq_remove_head(lfq_t *q, char *sp, size_t bufsize)
+{
+    int id = get_slot();
+    if (!q || id < 0)
+        return false;
+
+    lfq_slot_t *slot = &q->slots[id];
+    lfq_node_t *head, *next;
+    for (;;) {
+        head = protect(&slot->hp[0], &q->head);
+        lfq_node_t *tail = atomic_load(&q->tail);
+        next = protect(&slot->hp[1], &head->next);
+        if (head != atomic_load(&q->head))
+            continue;
+        if (!next) {
+            atomic_store(&slot->hp[0], NULL);
+            atomic_store(&slot->hp[1], NULL);
+            return false;
+        }
+        if (head == tail) {
+            atomic_compare_exchange_weak(&q->tail, &tail, next);
+            continue;
+        }
+        if (atomic_compare_exchange_weak(&q->head, &head, next))
+            break;
+    }
+
+    /* @next is the new dummy. Its value is ours now and stays readable while
+     * hp[1] protects it.
+     */
+    if (sp && bufsize) {
+        size_t len = strnlen(next->value, bufsize - 1);
+        memcpy(sp, next->value, len);
+        sp[len] = '\0';
+    }
+    atomic_store(&slot->hp[0], NULL);
+    atomic_store(&slot->hp[1], NULL);
+    atomic_fetch_sub(&q->size, 1);
+    retire(q, slot, head);
+    return true;
+}
+
+size_t lfq_size(lfq_t *q)
+{
+    return q ? atomic_load(&q->size) : 0;
+}
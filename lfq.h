@@ -0,0 +1,70 @@
+#ifndef LAB0_LFQ_H
+#define LAB0_LFQ_H
+
+/* Lock-free FIFO queue of strings for concurrent producers and consumers.
+ *
+ * This is the Michael-Scott queue: producers append at the tail and
+ * consumers take from the head, each with a single compare-and-swap on the
+ * contended path. Removed nodes are reclaimed with hazard pointers, so a
+ * consumer may still read a node another thread has just unlinked.
+ *
+ * Only the FIFO pair of the queue.h operations is provided; insertion at the
+ * head and removal at the tail have no lock-free counterpart in this design.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Maximum number of threads that may use lock-free queues at the same time */
+#define LFQ_MAX_THREADS 64
+
+typedef struct lfq lfq_t;
+
+/**
+ * lfq_new() - Create an empty lock-free queue
+ *
+ * Return: NULL for allocation failed
+ */
+lfq_t *lfq_new(void);
+
+/**
+ * lfq_free() - Free all storage used by queue, no effect if @q is NULL
+ * @q: queue to release
+ *
+ * No other thread may be using @q.
+ */
+void lfq_free(lfq_t *q);
+
+/**
+ * lfq_insert_tail() - Insert a copy of a string at the tail
+ * @q: queue to insert into
+ * @s: string to be copied
+ *
+ * Return: true for success, false for allocation failed, queue is NULL, or
+ * more than LFQ_MAX_THREADS threads using lock-free queues
+ */
+bool lfq_insert_tail(lfq_t *q, const char *s);
+
+/**
+ * lfq_remove_head() - Remove the element at the head
+ * @q: queue to remove from
+ * @sp: buffer receiving the removed string, may be NULL
+ * @bufsize: size of @sp
+ *
+ * Up to @bufsize - 1 characters are copied to @sp, plus a null terminator.
+ * @sp is left untouched if @bufsize is 0. The element itself is released by
+ * the queue.
+ *
+ * Return: true if an element was removed, false if queue is NULL or empty
+ */
+bool lfq_remove_head(lfq_t *q, char *sp, size_t bufsize);
+
+/**
+ * lfq_size() - Get the number of elements in queue
+ * @q: queue to inspect
+ *
+ * Exact only while no other thread is modifying @q.
+ */
+size_t lfq_size(lfq_t *q);
+
+#endif /* LAB0_LFQ_H */
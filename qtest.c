@@ -3,8 +3,11 @@
 #include <assert.h>
 #include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <spawn.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,9 +22,12 @@
 #include <time.h>
 #endif
 
+#include "bench.h"
 #include "dudect/fixture.h"
+#include "lfq.h"
 #include "list.h"
 #include "random.h"
+#include "sort.h"
 
 /* Shannon entropy */
 extern double shannon_entropy(const uint8_t *input_data);
@@ -46,6 +52,7 @@ extern int show_entropy;
 
 #include "console.h"
 #include "report.h"
+#include "snapshot.h"
 
 /* Settable parameters */
 
@@ -53,7 +60,6 @@ extern int show_entropy;
 
 /* How large is a queue before it's considered big.
  * This affects how it gets printed
- * and whether cautious mode is used when freeing the queue
  */
 #define BIG_LIST_SIZE 30
 
@@ -75,6 +81,19 @@ static int string_length = MAXSTRING;
 
 static int descend = 0;
 
+/* Insert repeated strings through the bulk functions instead of one by one */
+static int bulk_insert = 0;
+
+/* Account allocations to their call sites */
+static int profile = 0;
+
+/* Seed of the malloc failures, and the allocation the next one is forced on */
+static int fail_seed = 0;
+static int fail_nth = 0;
+
+/* Most call sites memstat can show */
+#define MEMSTAT_SITES 1024
+
 #define MIN_RANDSTR_LEN 5
 #define MAX_RANDSTR_LEN 10
 static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
@@ -101,9 +120,6 @@ static bool do_free(int argc, char *argv[])
     }
     error_check();
 
-    if (current && current->size > BIG_LIST_SIZE)
-        set_cautious_mode(false);
-
     struct list_head *qnext = NULL;
     if (chain.size > 1) {
         qnext = (current->chain.next == &chain.head) ? chain.head.next
@@ -116,7 +132,6 @@ static bool do_free(int argc, char *argv[])
         if (exception_setup(true))
             q_free(current->q);
         exception_cancel();
-        set_cautious_mode(true);
     }
 
     if (current) {
@@ -178,6 +193,91 @@ static void fill_rand_string(char *buf, size_t buf_size)
     buf[len] = '\0';
 }
 
+/* Elements queue_insert_n() inserts per call */
+#define INSERT_BATCH 1024
+
+/* Insert @reps copies of @inserts, or random strings if @need_rand, in
+ * batches through the bulk insertion functions
+ */
+static bool queue_insert_n(position_t pos,
+                           char *inserts,
+                           bool need_rand,
+                           int reps)
+{
+    char(*randstr_buf)[MAX_RANDSTR_LEN] = NULL;
+    char **strs = malloc(sizeof(char *) * INSERT_BATCH);
+    if (need_rand)
+        randstr_buf = malloc(MAX_RANDSTR_LEN * INSERT_BATCH);
+    if (!strs || (need_rand && !randstr_buf)) {
+        report(1,
+               "INTERNAL ERROR.  Could not allocate space for inserted "
+               "strings");
+        free(strs);
+        free(randstr_buf);
+        return false;
+    }
+    for (int i = 0; i < INSERT_BATCH; i++)
+        strs[i] = need_rand ? randstr_buf[i] : inserts;
+
+    bool ok = true;
+    char *lasts = NULL;
+    if (current && exception_setup(true)) {
+        for (int r = 0; ok && r < reps; r += INSERT_BATCH) {
+            int n = reps - r < INSERT_BATCH ? reps - r : INSERT_BATCH;
+            for (int i = 0; need_rand && i < n; i++)
+                fill_rand_string(randstr_buf[i], MAX_RANDSTR_LEN);
+
+            bool rval =
+                pos == POS_TAIL
+                    ? q_insert_tail_bulk(current->q, strs, need_rand ? n : 1,
+                                         n)
+                    : q_insert_head_bulk(current->q, strs, need_rand ? n : 1,
+                                         n);
+            if (!rval) {
+                fail_count++;
+                if (fail_count < fail_limit) {
+                    report(2, "Insertion of %d elements failed", n);
+                } else {
+                    report(1,
+                           "ERROR: Insertion of %d elements failed (%d "
+                           "failures total)",
+                           n, fail_count);
+                    ok = false;
+                }
+                continue;
+            }
+
+            current->size += n;
+            element_t *entry =
+                pos == POS_TAIL ? list_last_entry(current->q, element_t, list)
+                                : list_first_entry(current->q, element_t, list);
+            char *cur_inserts = entry->value;
+            if (!cur_inserts) {
+                report(1, "ERROR: Failed to save copy of string in queue");
+                ok = false;
+            } else if (cur_inserts == strs[n - 1]) {
+                report(1,
+                       "ERROR: Need to allocate and copy string for new "
+                       "queue element");
+                ok = false;
+            } else if (lasts == cur_inserts && !q_intern) {
+                report(1,
+                       "ERROR: Need to allocate separate string for each "
+                       "queue element");
+                ok = false;
+            }
+            lasts = cur_inserts;
+            ok = ok && !error_check();
+        }
+    }
+    exception_cancel();
+
+    q_show(3);
+    free(strs);
+    free(randstr_buf);
+    return ok;
+}
+
 /* insertion */
 static bool queue_insert(position_t pos, int argc, char *argv[])
 {
@@ -224,6 +324,12 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
                pos == POS_TAIL ? "tail" : "head");
     error_check();
 
+    /* A failed batch counts as a single failure, so injected malloc failures
+     * only mean what they do one element at a time
+     */
+    if (reps > 1 && bulk_insert && !fail_probability)
+        return queue_insert_n(pos, argv[1], need_rand, reps);
+
     if (current && exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
             if (need_rand)
@@ -246,7 +352,7 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
                            "queue element");
                     ok = false;
                     break;
-                } else if (r == 1 && lasts == cur_inserts) {
+                } else if (r == 1 && lasts == cur_inserts && !q_intern) {
                     report(1,
                            "ERROR: Need to allocate separate string for each "
                            "queue element");
@@ -286,6 +392,98 @@ static bool do_it(int argc, char *argv[])
     return queue_insert(POS_TAIL, argc, argv);
 }
 
+/* Elements queue_remove_n() removes per call */
+#define REMOVE_BATCH 256
+
+/* Remove @reps elements in batches, each of which has to hold @expect unless
+ * it is NULL
+ */
+static bool queue_remove_n(position_t pos, const char *expect, int reps)
+{
+    size_t stride = string_length + STRINGPAD + 1;
+    char *removes = malloc(stride * REMOVE_BATCH);
+    char *checks = malloc(string_length + 1);
+    char **sp = malloc(sizeof(char *) * REMOVE_BATCH);
+    element_t **elems = malloc(sizeof(element_t *) * REMOVE_BATCH);
+    if (!removes || !checks || !sp || !elems) {
+        report(1,
+               "INTERNAL ERROR.  Could not allocate space for removed strings");
+        free(removes);
+        free(checks);
+        free(sp);
+        free(elems);
+        return false;
+    }
+    for (int i = 0; i < REMOVE_BATCH; i++)
+        sp[i] = removes + i * stride;
+    if (expect) {
+        strncpy(checks, expect, string_length + 1);
+        checks[string_length] = '\0';
+    }
+
+    if (!current || current->size < reps)
+        report(3, "Warning: Calling remove %s on a queue that is too short",
+               pos == POS_TAIL ? "tail" : "head");
+    error_check();
+
+    bool ok = true;
+    while (ok && reps > 0) {
+        int n = reps < REMOVE_BATCH ? reps : REMOVE_BATCH;
+        for (int i = 0; i < n; i++) {
+            sp[i][0] = '\0';
+            memset(sp[i] + 1, 'X', string_length + STRINGPAD - 1);
+        }
+
+        int removed = 0;
+        if (current && exception_setup(true))
+            removed = pos == POS_TAIL
+                          ? q_remove_tail_n(current->q, elems, sp,
+                                            string_length + 1, n)
+                          : q_remove_head_n(current->q, elems, sp,
+                                            string_length + 1, n);
+        exception_cancel();
+
+        for (int i = 0; i < removed; i++) {
+            q_release_element(elems[i]);
+            current->size--;
+
+            if (sp[i][0] == '\0') {
+                report(1, "ERROR: Failed to store removed value");
+                ok = false;
+                continue;
+            }
+            int j = string_length + 1;
+            while (j < string_length + STRINGPAD && sp[i][j] == 'X')
+                j++;
+            if (j != string_length + STRINGPAD) {
+                report(1,
+                       "ERROR: copying of string in remove_head overflowed "
+                       "destination buffer.");
+                ok = false;
+            } else if (expect && strcmp(sp[i], checks)) {
+                report(1, "ERROR: Removed value %s != expected value %s",
+                       sp[i], checks);
+                ok = false;
+            }
+        }
+        if (removed < n) {
+            fail_count++;
+            report(1, "ERROR: Removal from queue failed (%d failures total)",
+                   fail_count);
+            ok = false;
+        }
+        reps -= n;
+    }
+
+    q_show(3);
+
+    free(removes);
+    free(checks);
+    free(sp);
+    free(elems);
+    return ok && !error_check();
+}
+
 static bool queue_remove(position_t pos, int argc, char *argv[])
 {
     /* FIXME: It is known that both functions is_remove_tail_const() and
@@ -310,10 +508,22 @@ static bool queue_remove(position_t pos, int argc, char *argv[])
     }
 #endif
 
-    if (argc != 1 && argc != 2) {
-        report(1, "%s needs 0-1 arguments", argv[0]);
+    if (argc > 3) {
+        report(1, "%s needs 0-2 arguments", argv[0]);
         return false;
     }
+    if (argc == 3) {
+        int reps;
+        if (!get_int(argv[2], &reps) || reps < 1) {
+            report(1, "Invalid number of removals '%s'", argv[2]);
+            return false;
+        }
+        /* A lone string would be taken for the expected value, so a count
+         * without one comes after -n
+         */
+        bool check = strcmp(argv[1], "-n");
+        return queue_remove_n(pos, check ? argv[1] : NULL, reps);
+    }
 
     char *removes = malloc(string_length + STRINGPAD + 1);
     if (!removes) {
@@ -415,10 +625,54 @@ static inline bool do_rt(int argc, char *argv[])
     return queue_remove(POS_TAIL, argc, argv);
 }
 
+/* Compare two copied strings through pointers to them, for qsort() */
+static int cmp_value_ptr(const void *a, const void *b)
+{
+    return strcmp(**(char *const *const *) a, **(char *const *const *) b);
+}
+
+/* Flag every element of @l, with @n elements, whose string occurs more than
+ * once anywhere in @l.
+ */
+static bool *find_dups_anywhere(struct list_head *l, int n)
+{
+    size_t cnt = n ? n : 1;
+    bool *dup = calloc(cnt, sizeof(bool));
+    char **values = malloc(sizeof(char *) * cnt);
+    char ***order = malloc(sizeof(char **) * cnt);
+    if (!dup || !values || !order) {
+        free(dup);
+        free(values);
+        free(order);
+        return NULL;
+    }
+
+    /* Sort pointers into @values, so that each one still tells where its
+     * string was in @l.
+     */
+    int i = 0;
+    element_t *item;
+    list_for_each_entry (item, l, list) {
+        values[i] = item->value;
+        order[i] = &values[i];
+        i++;
+    }
+    qsort(order, n, sizeof(char **), cmp_value_ptr);
+    for (i = 1; i < n; i++) {
+        if (!strcmp(*order[i - 1], *order[i]))
+            dup[order[i - 1] - values] = dup[order[i] - values] = true;
+    }
+
+    free(values);
+    free(order);
+    return dup;
+}
+
 static bool do_dedup(int argc, char *argv[])
 {
-    if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
+    bool hash = argc == 2 && !strcmp(argv[1], "hash");
+    if (argc != 1 && !hash) {
+        report(1, "%s takes no arguments or 'hash'", argv[0]);
         return false;
     }
 
@@ -431,6 +685,7 @@ static bool do_dedup(int argc, char *argv[])
     element_t *item = NULL, *tmp = NULL;
 
     // Copy current->q to l_copy
+    q_link(current->q);
     if (current->q && !list_empty(current->q)) {
         list_for_each_entry (item, current->q, list) {
             size_t slen;
@@ -460,9 +715,22 @@ static bool do_dedup(int argc, char *argv[])
         }
     }
 
+    // Without sorting, a string may have duplicates anywhere in the queue
+    bool *dups = NULL;
+    if (hash && !(dups = find_dups_anywhere(&l_copy, current->size))) {
+        list_for_each_entry_safe (item, tmp, &l_copy, list) {
+            free(item->value);
+            free(item);
+        }
+        report(1,
+               "INTERNAL ERROR.  Could not allocate space for duplicate "
+               "checking");
+        return false;
+    }
+
     bool ok = true;
     if (exception_setup(true))
-        ok = q_delete_dup(current->q);
+        ok = hash ? q_delete_dup_hash(current->q) : q_delete_dup(current->q);
     exception_cancel();
 
     if (!ok) {
@@ -470,12 +738,31 @@ static bool do_dedup(int argc, char *argv[])
             free(item->value);
             free(item);
         }
+        free(dups);
+        /* The hash table of a queue with elements could not be allocated,
+         * which leaves the queue as it was
+         */
+        if (hash && current->size) {
+            fail_count++;
+            if (fail_count < fail_limit) {
+                report(2, "Duplicate deletion failed");
+                ok = true;
+            } else {
+                report(1,
+                       "ERROR: Duplicate deletion failed (%d failures total)",
+                       fail_count);
+            }
+            q_show(3);
+            return ok && !error_check();
+        }
         report(1, "ERROR: Calling delete duplicate on null queue");
         return false;
     }
 
+    q_link(current->q);
     struct list_head *l_tmp = current->q->next;
     bool is_this_dup = false;
+    int pos = 0;
     // Compare between new list and old one
     list_for_each_entry (item, &l_copy, list) {
         // Skip comparison with new list if the string is duplicate
@@ -483,7 +770,7 @@ static bool do_dedup(int argc, char *argv[])
             item->list.next != &l_copy &&
             strcmp(list_entry(item->list.next, element_t, list)->value,
                    item->value) == 0;
-        if (is_this_dup || is_next_dup) {
+        if (hash ? dups[pos++] : is_this_dup || is_next_dup) {
             // Update list size
             current->size--;
         } else if (l_tmp != current->q &&
@@ -505,6 +792,7 @@ static bool do_dedup(int argc, char *argv[])
         free(item->value);
         free(item);
     }
+    free(dups);
 
     q_show(3);
     return ok && !error_check();
@@ -533,6 +821,21 @@ static bool do_reverse(int argc, char *argv[])
 
 static bool do_size(int argc, char *argv[])
 {
+    if (simulation) {
+        if (argc != 1) {
+            report(1, "%s does not need arguments in simulation mode", argv[0]);
+            return false;
+        }
+        bool ok = is_size_const();
+        if (!ok) {
+            report(1,
+                   "ERROR: Probably not constant time or wrong implementation");
+            return false;
+        }
+        report(1, "Probably constant time");
+        return ok;
+    }
+
     if (argc != 1 && argc != 2) {
         report(1, "%s takes 0-1 arguments", argv[0]);
         return false;
@@ -605,6 +908,7 @@ bool do_sort(int argc, char *argv[])
 
     bool ok = true;
     if (current && current->size) {
+        q_link(current->q);
         for (struct list_head *cur_l = current->q->next;
              cur_l != current->q && --cnt; cur_l = cur_l->next) {
             /* Ensure each element in ascending/descending order */
@@ -709,6 +1013,7 @@ static bool do_ascend(int argc, char *argv[])
 
     cnt = current->size;
     if (current->size) {
+        q_link(current->q);
         for (struct list_head *cur_l = current->q->next;
              cur_l != current->q && --cnt; cur_l = cur_l->next) {
             element_t *item, *next_item;
@@ -756,6 +1061,7 @@ static bool do_descend(int argc, char *argv[])
 
     cnt = current->size;
     if (current->size) {
+        q_link(current->q);
         for (struct list_head *cur_l = current->q->next;
              cur_l != current->q && --cnt; cur_l = cur_l->next) {
             element_t *item, *next_item;
@@ -824,7 +1130,7 @@ static bool do_merge(int argc, char *argv[])
     exception_cancel();
     set_noallocate_mode(false);
 
-    if (q_size(&chain.head) > 1) {
+    if (chain.size > 1) {
         chain.size = 1;
         current = list_entry(chain.head.next, queue_contex_t, chain);
         current->size = len;
@@ -843,6 +1149,7 @@ static bool do_merge(int argc, char *argv[])
 
     bool ok = true;
     if (current && current->size) {
+        q_link(current->q);
         for (struct list_head *cur_l = current->q->next;
              cur_l != current->q && --len; cur_l = cur_l->next) {
             /* Ensure each element in ascending order */
@@ -875,6 +1182,383 @@ static bool do_merge(int argc, char *argv[])
     return ok && !error_check();
 }
 
+/* Per-thread state of the lock-free queue stress test */
+typedef struct {
+    lfq_t *q;
+    int id;
+    int ops;
+    atomic_bool *start;
+    uint64_t *log; /* (producer << 32 | sequence) of each removed value */
+    int n_log;
+    int n_failed; /* inserts refused by the allocator */
+    bool empty_seen;
+} stress_worker_t;
+
+static void *stress_worker(void *arg)
+{
+    stress_worker_t *w = arg;
+    char buf[32];
+
+    while (!atomic_load(w->start))
+        sched_yield();
+    for (int i = 0; i < w->ops; i++) {
+        snprintf(buf, sizeof(buf), "%d:%d", w->id, i);
+        if (!lfq_insert_tail(w->q, buf)) {
+            w->n_failed++;
+            continue;
+        }
+        /* This thread has inserted more than it has removed, so the queue
+         * can never be seen empty here.
+         */
+        if (!lfq_remove_head(w->q, buf, sizeof(buf))) {
+            w->empty_seen = true;
+            break;
+        }
+        char *sep;
+        uint64_t producer = strtoul(buf, &sep, 10);
+        uint64_t seq = strtoul(sep + 1, NULL, 10);
+        w->log[w->n_log++] = producer << 32 | seq;
+    }
+    return NULL;
+}
+
+/* Check that the removals of one run could come from a sequential FIFO queue:
+ * every inserted value is removed exactly once, and each consumer sees the
+ * values of each producer in insertion order.
+ */
+static bool stress_verify(stress_worker_t *workers, int nthreads, int ops)
+{
+    bool *seen = calloc((size_t) nthreads * ops, sizeof(bool));
+    int *last = malloc(sizeof(int) * nthreads);
+    bool ok = seen && last;
+    if (!ok)
+        report(1, "ERROR: Could not allocate space for verification");
+
+    size_t inserted = 0, removed = 0;
+    for (int c = 0; ok && c < nthreads; c++) {
+        stress_worker_t *w = &workers[c];
+        if (w->empty_seen) {
+            report(1, "ERROR: Thread %d found the queue empty", c);
+            ok = false;
+            break;
+        }
+        if (w->n_log != ops - w->n_failed) {
+            report(1, "ERROR: Thread %d completed %d of %d operations", c,
+                   w->n_log, ops - w->n_failed);
+            ok = false;
+            break;
+        }
+        inserted += ops - w->n_failed;
+        for (int p = 0; p < nthreads; p++)
+            last[p] = -1;
+        for (int i = 0; i < w->n_log; i++) {
+            int p = w->log[i] >> 32;
+            int seq = w->log[i] & 0xffffffff;
+            if (p >= nthreads || seq >= ops || seen[(size_t) p * ops + seq]) {
+                report(1, "ERROR: Thread %d removed %d:%d more than once", c,
+                       p, seq);
+                ok = false;
+                break;
+            }
+            if (seq <= last[p]) {
+                report(1,
+                       "ERROR: Thread %d removed %d:%d after %d:%d, out of "
+                       "FIFO order",
+                       c, p, seq, p, last[p]);
+                ok = false;
+                break;
+            }
+            seen[(size_t) p * ops + seq] = true;
+            last[p] = seq;
+            removed++;
+        }
+    }
+
+    if (ok && removed != inserted) {
+        report(1, "ERROR: %zu values lost", inserted - removed);
+        ok = false;
+    }
+
+    free(seen);
+    free(last);
+    return ok;
+}
+
+static bool stress_run(int nthreads, int ops)
+{
+    lfq_t *q = lfq_new();
+    stress_worker_t *workers = calloc(nthreads, sizeof(stress_worker_t));
+    pthread_t *tids = malloc(sizeof(pthread_t) * nthreads);
+    atomic_bool start = false;
+    bool ok = q && workers && tids;
+
+    for (int i = 0; ok && i < nthreads; i++) {
+        workers[i].log = malloc(sizeof(uint64_t) * ops);
+        ok = workers[i].log;
+    }
+    if (!ok) {
+        report(1, "ERROR: Could not allocate space for %d threads", nthreads);
+        goto out;
+    }
+
+    /* The workers inherit a mask that keeps SIGALRM and friends away */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int created = 0;
+    for (; created < nthreads; created++) {
+        stress_worker_t *w = &workers[created];
+        w->q = q;
+        w->id = created;
+        w->ops = ops;
+        w->start = &start;
+        if (pthread_create(&tids[created], NULL, stress_worker, w))
+            break;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    atomic_store(&start, true);
+    for (int i = 0; i < created; i++)
+        pthread_join(tids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (created < nthreads) {
+        report(1, "ERROR: Could only create %d of %d threads", created,
+               nthreads);
+        ok = false;
+    }
+
+    double elapsed = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+    if (ok)
+        ok = stress_verify(workers, nthreads, ops);
+    if (ok && lfq_size(q)) {
+        report(1, "ERROR: %zu elements left in queue", lfq_size(q));
+        ok = false;
+    }
+    if (ok)
+        report(1, "threads %2d: %.0f ops/sec", nthreads,
+               2.0 * nthreads * ops / elapsed);
+
+out:
+    for (int i = 0; workers && i < nthreads; i++)
+        free(workers[i].log);
+    free(workers);
+    free(tids);
+    lfq_free(q);
+    return ok;
+}
+
+static bool do_stress(int argc, char *argv[])
+{
+    int nthreads = 4, ops = 100000;
+
+    if (argc > 3) {
+        report(1, "%s takes 0-2 arguments", argv[0]);
+        return false;
+    }
+    if (argc > 1 && (!get_int(argv[1], &nthreads) || nthreads < 1 ||
+                     nthreads > LFQ_MAX_THREADS)) {
+        report(1, "Number of threads must be between 1 and %d",
+               LFQ_MAX_THREADS);
+        return false;
+    }
+    if (argc > 2 && (!get_int(argv[2], &ops) || ops < 1)) {
+        report(1, "Invalid number of operations '%s'", argv[2]);
+        return false;
+    }
+
+    /* Double the thread count up to the requested one */
+    bool ok = true;
+    for (int n = 1; ok; n *= 2) {
+        if (n > nthreads)
+            n = nthreads;
+        ok = stress_run(n, ops);
+        if (n == nthreads)
+            break;
+    }
+    return ok;
+}
+
+static int cmp_site_bytes(const void *a, const void *b)
+{
+    const alloc_site_t *x = a, *y = b;
+    return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+static bool do_memstat(int argc, char *argv[])
+{
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "reset"))) {
+        report(1, "%s takes no arguments or 'reset'", argv[0]);
+        return false;
+    }
+    if (argc == 2) {
+        profile_reset();
+        return true;
+    }
+    if (!profile)
+        report(1, "Warning: profiling is off, see 'option profile'");
+
+    alloc_site_t *sites = malloc(sizeof(alloc_site_t) * MEMSTAT_SITES);
+    if (!sites) {
+        report(1, "ERROR: Could not allocate space for call sites");
+        return false;
+    }
+    size_t n = profile_sites(sites, MEMSTAT_SITES);
+    qsort(sites, n, sizeof(alloc_site_t), cmp_site_bytes);
+
+    static const char *bucket_names[PROFILE_BUCKETS] = {
+        "<1us", "<10us", "<100us", "<1ms", "<10ms", "<100ms", "<1s", ">=1s",
+    };
+    report_noreturn(1, "%-28s %9s %11s %7s %11s %11s", "site", "allocs",
+                    "bytes", "avg", "live", "peak");
+    for (int b = 0; b < PROFILE_BUCKETS; b++)
+        report_noreturn(1, " %7s", bucket_names[b]);
+    report(1, "");
+    for (size_t i = 0; i < n; i++) {
+        const alloc_site_t *s = &sites[i];
+        char name[64];
+        alloc_site_name(s->site, name, sizeof(name));
+        report_noreturn(1, "%-28s %9zu %11zu %7.1f %11zu %11zu", name,
+                        s->allocs, s->bytes,
+                        s->allocs ? (double) s->bytes / s->allocs : 0.0,
+                        s->live_bytes, s->peak_bytes);
+        for (int b = 0; b < PROFILE_BUCKETS; b++)
+            report_noreturn(1, " %7zu", s->lifetime[b]);
+        report(1, "");
+    }
+    free(sites);
+    if (intern_count())
+        report(1, "%zu distinct strings interned", intern_count());
+    return true;
+}
+
+/* Check the aligned allocators of the harness against their contract: an
+ * invalid alignment must be refused with EINVAL, a valid one honored
+ */
+static bool do_memalign(int argc, char *argv[])
+{
+    int align, size;
+    if (argc != 3 || !get_int(argv[1], &align) || !get_int(argv[2], &size) ||
+        align < 0 || size < 0) {
+        report(1, "%s needs an alignment and a size", argv[0]);
+        return false;
+    }
+
+    /* The harness takes powers of two up to HARNESS_MAX_ALIGN, and
+     * posix_memalign() also wants a multiple of the size of a pointer
+     */
+    bool pow2 = align && !(align & (align - 1)) &&
+                (size_t) align <= HARNESS_MAX_ALIGN;
+    bool valid[] = {pow2, pow2 && !(align % sizeof(void *))};
+    static const char *names[] = {"aligned_alloc", "posix_memalign"};
+    bool ok = true;
+    for (int i = 0; i < 2; i++) {
+        void *p = NULL;
+        int err = 0;
+        if (i == 0) {
+            p = test_aligned_alloc(align, size);
+            err = p ? 0 : errno;
+        } else {
+            err = test_posix_memalign(&p, align, size);
+        }
+
+        if (err == ENOMEM) {
+            report(1, "%s(%d, %d) failed to allocate", names[i], align, size);
+        } else if (err == EINVAL) {
+            report(1, "%s(%d, %d) refused the alignment", names[i], align,
+                   size);
+            ok = ok && !valid[i];
+        } else if (!valid[i] || (uintptr_t) p % align) {
+            report(1, "ERROR: %s(%d, %d) returned %p", names[i], align, size,
+                   p);
+            ok = false;
+        } else {
+            report(1, "%s(%d, %d) returned an aligned block", names[i], align,
+                   size);
+        }
+        test_free(p);
+    }
+    return ok && !error_check();
+}
+
+/* Byte memrealloc expects at offset @i of its block */
+static inline unsigned char pattern_at(size_t i)
+{
+    return (unsigned char) (i * 31 + 7);
+}
+
+/* Does the block at @p hold the pattern in its first @n bytes? */
+static bool pattern_kept(const unsigned char *p, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (p[i] != pattern_at(i))
+            return false;
+    }
+    return true;
+}
+
+static bool do_memrealloc(int argc, char *argv[])
+{
+    if (argc < 2) {
+        report(1, "%s needs at least one size", argv[0]);
+        return false;
+    }
+
+    size_t blocks = allocation_check();
+    unsigned char *p = NULL;
+    int size = 0;
+    bool ok = true;
+    for (int i = 1; ok && i < argc; i++) {
+        int n;
+        if (!get_int(argv[i], &n) || n < 0) {
+            report(1, "Invalid size '%s'", argv[i]);
+            ok = false;
+            break;
+        }
+
+        unsigned char *new = test_realloc(p, n);
+        if (!new && n) {
+            /* A failed realloc() must leave the block as it was */
+            report(2, "realloc(%d) failed", n);
+            if (!pattern_kept(p, size)) {
+                report(1, "ERROR: Failed realloc(%d) changed the block", n);
+                ok = false;
+            }
+        } else {
+            int kept = size < n ? size : n;
+            if (!pattern_kept(new, kept)) {
+                report(1, "ERROR: realloc(%d) lost the first %d bytes", n,
+                       kept);
+                ok = false;
+            }
+            for (int j = kept; j < n; j++)
+                new[j] = pattern_at(j);
+            p = new;
+            size = n;
+        }
+
+        if (allocation_check() != blocks + !!p) {
+            report(1, "ERROR: %lu blocks allocated after realloc(%d), not %lu",
+                   allocation_check(), n, blocks + !!p);
+            ok = false;
+        }
+    }
+    test_free(p);
+    return ok && !error_check();
+}
+
+static bool do_failsite(int argc, char *argv[])
+{
+    if (argc > 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+    set_fail_site(argc == 2 ? argv[1] : NULL);
+    return true;
+}
+
 static bool is_circular()
 {
     struct list_head *cur = current->q->next;
@@ -904,6 +1588,7 @@ static bool q_show(int vlevel)
         report(vlevel, "l = NULL");
         return true;
     }
+    q_link(current->q);
 
     if (!is_circular()) {
         report(vlevel, "ERROR:  Queue is not doubly circular");
@@ -1012,12 +1697,114 @@ static bool do_next(int argc, char *argv[])
     return q_show(0);
 }
 
+static bool do_save(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    bool ok = false;
+    if (exception_setup(true))
+        ok = snapshot_save(argv[1], &chain.head, current);
+    exception_cancel();
+
+    return ok && !error_check();
+}
+
+static bool do_load(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    LIST_HEAD(loaded);
+    queue_contex_t *cur = NULL;
+    int n = -1;
+    if (exception_setup(true))
+        n = snapshot_load(argv[1], &loaded, &cur);
+    exception_cancel();
+    if (n < 0)
+        return false;
+
+    /* The loaded queues join the chain as if created by new */
+    queue_contex_t *qctx;
+    list_for_each_entry (qctx, &loaded, chain)
+        qctx->id = chain.size++;
+    list_splice_tail(&loaded, &chain.head);
+    if (cur)
+        current = cur;
+    else if (n > 0 && !current)
+        current = list_last_entry(&chain.head, queue_contex_t, chain);
+
+    q_show(3);
+    return !error_check();
+}
+
+static void sortalgo_setter(int oldval)
+{
+    if (sort_algo < 0 || sort_algo >= N_SORT_ALGO) {
+        report(1, "Unknown sort engine %d", sort_algo);
+        sort_algo = oldval;
+    }
+}
+
+static void seed_setter(int oldval)
+{
+    set_fail_seed(fail_seed);
+}
+
+/* Tell the seed once malloc failures are turned on, so that they can be
+ * repeated, without cluttering the output of runs that have none
+ */
+static void malloc_setter(int oldval)
+{
+    if (fail_probability && !oldval)
+        report(1, "Malloc failure seed: %d (rerun with -s %d)", fail_seed,
+               fail_seed);
+}
+
+static void failnth_setter(int oldval)
+{
+    set_fail_nth(fail_nth);
+}
+
+static void backend_setter(int oldval)
+{
+    if (q_backend < 0 || q_backend >= N_Q_BACKEND) {
+        report(1, "Unknown queue backend %d", q_backend);
+        q_backend = oldval;
+    }
+}
+
+static void profile_setter(int oldval)
+{
+    set_profile_mode(profile);
+}
+
+static void threads_setter(int oldval)
+{
+    if (sort_threads < 1 || sort_threads > MAX_SORT_THREADS) {
+        report(1, "Number of sort threads must be between 1 and %d",
+               MAX_SORT_THREADS);
+        sort_threads = oldval;
+    }
+}
+
 static void console_init()
 {
     ADD_COMMAND(new, "Create new queue", "");
     ADD_COMMAND(free, "Delete queue", "");
     ADD_COMMAND(prev, "Switch to previous queue", "");
     ADD_COMMAND(next, "Switch to next queue", "");
+    ADD_COMMAND(save,
+                "Save all the queues, and which one is current, to file f",
+                "f");
+    ADD_COMMAND(load,
+                "Load the queues saved in file f as new queues, keeping their "
+                "strings in the file",
+                "f");
     ADD_COMMAND(ih,
                 "Insert string str at head of queue n times. Generate random "
                 "string(s) if str equals RAND. (default: n == 1)",
@@ -1026,20 +1813,25 @@ static void console_init()
                 "Insert string str at tail of queue n times. Generate random "
                 "string(s) if str equals RAND. (default: n == 1)",
                 "str [n]");
-    ADD_COMMAND(
-        rh,
-        "Remove from head of queue. Optionally compare to expected value str",
-        "[str]");
-    ADD_COMMAND(
-        rt,
-        "Remove from tail of queue. Optionally compare to expected value str",
-        "[str]");
+    ADD_COMMAND(rh,
+                "Remove from head of queue. Optionally compare to expected "
+                "value str, n times in batches (default: n == 1). With -n, "
+                "remove n without comparing",
+                "[str [n] | -n n]");
+    ADD_COMMAND(rt,
+                "Remove from tail of queue. Optionally compare to expected "
+                "value str, n times in batches (default: n == 1). With -n, "
+                "remove n without comparing",
+                "[str [n] | -n n]");
     ADD_COMMAND(reverse, "Reverse queue", "");
     ADD_COMMAND(sort, "Sort queue in ascending/descening order", "");
     ADD_COMMAND(size, "Compute queue size n times (default: n == 1)", "[n]");
     ADD_COMMAND(show, "Show queue contents", "");
     ADD_COMMAND(dm, "Delete middle node in queue", "");
-    ADD_COMMAND(dedup, "Delete all nodes that have duplicate string", "");
+    ADD_COMMAND(dedup,
+                "Delete all nodes that have duplicate string. With 'hash', "
+                "duplicates need not be adjacent",
+                "[hash]");
     ADD_COMMAND(merge, "Merge all the queues into one sorted queue", "");
     ADD_COMMAND(swap, "Swap every two adjacent nodes in queue", "");
     ADD_COMMAND(ascend,
@@ -1052,14 +1844,60 @@ static void console_init()
                 "");
     ADD_COMMAND(reverseK, "Reverse the nodes of the queue 'K' at a time",
                 "[K]");
+    ADD_COMMAND(stress,
+                "Run n operations per thread on a lock-free queue with 1, 2, "
+                "4, ... up to t threads, verify FIFO order and report "
+                "throughput (default: t == 4, n == 100000)",
+                "[t] [n]");
+    ADD_COMMAND(failsite,
+                "Make every allocation at call site s fail, as memstat names "
+                "it or by the queue function making it. Without s, stop",
+                "[s]");
+    ADD_COMMAND(memalign,
+                "Allocate and free a block of n bytes aligned to a bytes "
+                "through the harness, checking invalid alignments are refused",
+                "a n");
+    ADD_COMMAND(memrealloc,
+                "Resize a block through the harness realloc to each size in "
+                "turn, checking its contents and the blocks allocated",
+                "n ...");
+    ADD_COMMAND(memstat,
+                "Show allocations per call site, or restart counting with "
+                "'reset'",
+                "[reset]");
     add_param("length", &string_length, "Maximum length of displayed string",
               NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent",
-              NULL);
+              malloc_setter);
+    add_param("seed", &fail_seed, "Seed of the malloc failures", seed_setter);
+    add_param("failnth", &fail_nth,
+              "Make the n-th allocation from now fail (0: none)",
+              failnth_setter);
     add_param("fail", &fail_limit,
               "Number of times allow queue operations to return false", NULL);
     add_param("descend", &descend,
               "Sort and merge queue in ascending/descending order", NULL);
+    add_param("sortalgo", &sort_algo,
+              "Sort engine (0: merge sort, 1: array radix sort, 2: list radix "
+              "sort)",
+              sortalgo_setter);
+    add_param("backend", &q_backend,
+              "Backend of new queues (0: linked list, 1: chunked, 2: ring)",
+              backend_setter);
+    add_param("bulk", &bulk_insert,
+              "Insert repeated strings in batches through the bulk insertion "
+              "functions, unless malloc failures are injected",
+              NULL);
+    add_param("intern", &q_intern,
+              "Share one copy of equal strings among the elements holding "
+              "them",
+              NULL);
+    add_param("threads", &sort_threads,
+              "Number of threads the list sort engines may use",
+              threads_setter);
+    add_param("profile", &profile,
+              "Account allocations to call sites for memstat", profile_setter);
+    init_bench();
 }
 
 /* Signal handlers */
@@ -1092,8 +1930,6 @@ static void q_init()
 static bool q_quit(int argc, char *argv[])
 {
     report(3, "Freeing queue");
-    if (current && current->size > BIG_LIST_SIZE)
-        set_cautious_mode(false);
 
     if (exception_setup(true)) {
         struct list_head *cur = chain.head.next;
@@ -1107,7 +1943,6 @@ static bool q_quit(int argc, char *argv[])
     }
 
     exception_cancel();
-    set_cautious_mode(true);
 
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
@@ -1121,11 +1956,15 @@ static bool q_quit(int argc, char *argv[])
 
 static void usage(char *cmd)
 {
-    printf("Usage: %s [-h] [-f IFILE][-v VLEVEL][-l LFILE]\n", cmd);
+    printf(
+        "Usage: %s [-h] [-f IFILE][-v VLEVEL][-l LFILE][-s SEED][-b BACKEND]\n",
+        cmd);
     printf("\t-h         Print this information\n");
     printf("\t-f IFILE   Read commands from IFILE\n");
     printf("\t-v VLEVEL  Set verbosity level\n");
     printf("\t-l LFILE   Echo results to LFILE\n");
+    printf("\t-s SEED    Seed the malloc failures with SEED\n");
+    printf("\t-b BACKEND Create queues with BACKEND, as 'option backend'\n");
     exit(0);
 }
 
@@ -1195,8 +2034,9 @@ int main(int argc, char *argv[])
     char *logfile_name = NULL;
     int level = 4;
     int c;
+    bool seeded = false;
 
-    while ((c = getopt(argc, argv, "hv:f:l:")) != -1) {
+    while ((c = getopt(argc, argv, "hv:f:l:s:b:")) != -1) {
         switch (c) {
         case 'h':
             usage(argv[0]);
@@ -1221,6 +2061,20 @@ int main(int argc, char *argv[])
             buf[BUFSIZE - 1] = '\0';
             logfile_name = lbuf;
             break;
+        case 's':
+            if (!get_int(optarg, &fail_seed)) {
+                fprintf(stderr, "Invalid seed\n");
+                exit(EXIT_FAILURE);
+            }
+            seeded = true;
+            break;
+        case 'b':
+            if (!get_int(optarg, &q_backend) || q_backend < 0 ||
+                q_backend >= N_Q_BACKEND) {
+                fprintf(stderr, "Invalid backend\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
         default:
             printf("Unknown option '%c'\n", c);
             usage(argv[0]);
@@ -1232,6 +2086,9 @@ int main(int argc, char *argv[])
      * with the Unix time.
      */
     srand(os_random(getpid() ^ getppid()));
+    if (!seeded)
+        fail_seed = rand();
+    set_fail_seed(fail_seed);
 
     q_init();
     init_cmd();
@@ -1251,7 +2108,6 @@ int main(int argc, char *argv[])
         set_echo(true);
     if (logfile_name)
         set_logfile(logfile_name);
-
     add_quit_helper(q_quit);
 
     bool ok = true;
@@ -2,8 +2,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "deque.h"
+#include "hash.h"
 #include "list.h"
 #include "queue.h"
+#include "ring.h"
+#include "sort.h"
 
 /* Notice: sometimes, Cppcheck would find the potential NULL pointer bugs,
  * but some of them cannot occur. You can suppress them by adding the
@@ -11,14 +15,143 @@
  *   cppcheck-suppress nullPointer
  */
 
+/* The list head handed out by q_new() is the first member of this structure,
+ * so queue-wide bookkeeping lives next to the list without changing the
+ * interface in queue.h.
+ * @size: number of elements, maintained by every operation that links or
+ *        unlinks a node so that q_size() never has to walk the list
+ * @backend: how the elements are held, one of q_backend_t
+ * @linked: whether the links of the elements match their order, which is
+ *          always the case for Q_LIST
+ * @chunks: the elements of a Q_CHUNKED queue
+ * @ring: the elements of a Q_RING queue
+ * @scratch: room for the SORT_ARRAY engine, which has to run while allocation
+ *           is disallowed and therefore reserves it as the queue grows
+ * @scratch_cap: number of entries @scratch can hold
+ * @child: first subheap while q_merge() holds the queue in its heap
+ * @sibling: next subheap with the same parent in that heap
+ */
+typedef struct queue {
+    struct list_head head;
+    int size;
+    int backend;
+    bool linked;
+    deque_t chunks;
+    ring_t ring;
+    sort_entry_t *scratch;
+    int scratch_cap;
+    struct queue *child, *sibling;
+} queue_t;
+
+/* Smallest scratch array worth allocating */
+#define SCRATCH_MIN 64
+
+int q_backend = Q_LIST;
+
+int q_intern = 0;
+
+static inline queue_t *to_queue(struct list_head *head)
+{
+    return list_entry(head, queue_t, head);
+}
+
+/* Point the head of a chunked or ring queue at its first and last element
+ * after they changed, which leaves the links between the elements stale.
+ */
+static void set_ends(queue_t *q)
+{
+    element_t *first, *last;
+    if (q->backend == Q_RING) {
+        first = ring_front(&q->ring);
+        last = ring_back(&q->ring);
+    } else {
+        first = deque_front(&q->chunks);
+        last = deque_back(&q->chunks);
+    }
+    q->head.next = first ? &first->list : &q->head;
+    q->head.prev = last ? &last->list : &q->head;
+    q->linked = false;
+}
+
+/* Link the elements of queue in order */
+void q_link(struct list_head *head)
+{
+    if (!head || to_queue(head)->linked)
+        return;
+
+    queue_t *q = to_queue(head);
+    INIT_LIST_HEAD(head);
+    if (q->backend == Q_RING) {
+        for (size_t i = 0; i < q->ring.size; i++)
+            list_add_tail(&((element_t *) ring_at(&q->ring, i))->list, head);
+    } else {
+        deque_chunk_t *c;
+        int i;
+        deque_for_each(c, i, &q->chunks)
+            list_add_tail(&((element_t *) c->slot[i])->list, head);
+    }
+    q->linked = true;
+}
+
+/* Operations without a chunked or ring counterpart run on the list that
+ * q_link() builds, then put the elements back in their new order. Those
+ * operations never add elements, so the chunks or the buffer the queue
+ * already has are enough and nothing is allocated.
+ */
+static void q_store(struct list_head *head)
+{
+    if (!head || to_queue(head)->backend == Q_LIST)
+        return;
+
+    queue_t *q = to_queue(head);
+    element_t *e;
+    if (q->backend == Q_RING) {
+        ring_clear(&q->ring);
+        list_for_each_entry (e, head, list)
+            ring_push_back(&q->ring, e);
+    } else {
+        deque_clear(&q->chunks);
+        list_for_each_entry (e, head, list)
+            deque_push_back(&q->chunks, e);
+    }
+    q->linked = true;
+}
+
+/* Keep the scratch array at least as large as the queue while the array sort
+ * engine is selected. Failing to grow it is harmless: q_sort() then falls
+ * back to merge sort.
+ */
+static void reserve_scratch(queue_t *q)
+{
+    if (sort_algo != SORT_ARRAY || q->size <= q->scratch_cap)
+        return;
+
+    int cap = q->scratch_cap ? q->scratch_cap : SCRATCH_MIN;
+    while (cap < q->size)
+        cap *= 2;
+    sort_entry_t *scratch = malloc(sizeof(sort_entry_t) * cap);
+    if (!scratch)
+        return;
+    free(q->scratch);
+    q->scratch = scratch;
+    q->scratch_cap = cap;
+}
 
 /* Create an empty queue */
 struct list_head *q_new()
 {
-    struct list_head *head = malloc(sizeof(struct list_head));
-    if (head)
-        INIT_LIST_HEAD(head);
-    return head;
+    queue_t *q = malloc(sizeof(queue_t));
+    if (!q)
+        return NULL;
+    INIT_LIST_HEAD(&q->head);
+    q->size = 0;
+    q->backend = q_backend;
+    q->linked = true;
+    deque_init(&q->chunks);
+    ring_init(&q->ring);
+    q->scratch = NULL;
+    q->scratch_cap = 0;
+    return &q->head;
 }
 
 /* Free all storage used by queue */
@@ -27,14 +160,378 @@ void q_free(struct list_head *l)
     if (!l)
         return;
 
-    struct list_head *list_node;
-    struct list_head *safe;
-    list_for_each_safe (list_node, safe, l) {
-        element_t *element_node = list_entry(list_node, element_t, list);
-        q_release_element(element_node);
+    queue_t *q = to_queue(l);
+    if (q->backend == Q_CHUNKED) {
+        deque_chunk_t *c;
+        int i;
+        deque_for_each(c, i, &q->chunks)
+            q_release_element(c->slot[i]);
+    } else if (q->backend == Q_RING) {
+        for (size_t i = 0; i < q->ring.size; i++)
+            q_release_element(ring_at(&q->ring, i));
+    } else {
+        struct list_head *list_node;
+        struct list_head *safe;
+        list_for_each_safe (list_node, safe, l) {
+            element_t *element_node = list_entry(list_node, element_t, list);
+            q_release_element(element_node);
+        }
     }
 
-    free(l);
+    deque_destroy(&q->chunks);
+    ring_destroy(&q->ring);
+    free(q->scratch);
+    free(q);
+}
+
+/* Pack the first Q_PREFIX_BYTES bytes of a string of length @len */
+static inline uint32_t value_prefix(const char *s, size_t len)
+{
+    uint32_t prefix = 0;
+    for (size_t i = 0; i < Q_PREFIX_BYTES; i++)
+        prefix = prefix << 8 | (i < len ? (unsigned char) s[i] : 0);
+    return prefix;
+}
+
+/* Allocate an element with a copy of @s packed right behind it, so that the
+ * node and its string come from one block and go away with one free. An
+ * interned string lives elsewhere and only the node is allocated.
+ */
+static element_t *element_new(const char *s)
+{
+    size_t len = strlen(s);
+    if (len > INT32_MAX)
+        return NULL;
+
+    element_t *element_node;
+    if (q_intern) {
+        element_node = malloc(sizeof(element_t));
+        if (!element_node)
+            return NULL;
+        element_node->value = intern_get(s, len);
+        if (!element_node->value) {
+            free(element_node);
+            return NULL;
+        }
+    } else {
+        element_node = malloc(sizeof(element_t) + len + 1);
+        if (!element_node)
+            return NULL;
+        element_node->value = (char *) (element_node + 1);
+        memcpy(element_node->value, s, len + 1);
+    }
+    element_node->len = len;
+    element_node->bulk = 0;
+    element_node->prefix = value_prefix(s, len);
+    return element_node;
+}
+
+/* Elements of a bulk insertion come from a single block starting with this
+ * header. Each element is preceded by a pointer to the header and followed by
+ * its string, unless that is interned or belongs to a view.
+ */
+typedef struct {
+    size_t live;     /* elements not released yet */
+    q_view_t *view;  /* owner of the strings, NULL unless inserted in place */
+} bulk_block_t;
+
+/* Bytes an element of a bulk block takes, given the length of its string */
+static inline size_t bulk_record_size(size_t len)
+{
+    size_t size = sizeof(bulk_block_t *) + sizeof(element_t);
+    if (!q_intern)
+        size += len + 1;
+    return (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
+void q_release_bulk(element_t *e)
+{
+    bulk_block_t *blk = ((bulk_block_t **) e)[-1];
+    q_view_t *view = blk->view;
+    if (!view && e->value != (char *) (e + 1))
+        intern_put(e->value);
+    if (--blk->live)
+        return;
+    free(blk);
+    if (view && !--view->refs)
+        view->release(view);
+}
+
+/* Build the elements of a bulk insertion on @batch, in the order they end up
+ * in the queue
+ */
+static bool bulk_new(struct list_head *batch,
+                     char **s,
+                     int cnt,
+                     int n,
+                     bool tail)
+{
+    /* Size a cycle through @s once, then the partial cycle at the end */
+    size_t cycle = 0, part = 0;
+    for (int j = 0; j < cnt && j < n; j++) {
+        size_t len = strlen(s[j]);
+        if (len > INT32_MAX)
+            return false;
+        cycle += bulk_record_size(len);
+        if (j < n % cnt)
+            part += bulk_record_size(len);
+    }
+    bulk_block_t *blk =
+        malloc(sizeof(bulk_block_t) + cycle * (n / cnt) + part);
+    if (!blk)
+        return false;
+    blk->live = n;
+    blk->view = NULL;
+
+    char *p = (char *) (blk + 1);
+    for (int i = 0; i < n; i++) {
+        const char *str = s[i % cnt];
+        size_t len = strlen(str);
+        *(bulk_block_t **) p = blk;
+        element_t *e = (element_t *) (p + sizeof(bulk_block_t *));
+        if (!q_intern) {
+            e->value = (char *) (e + 1);
+            memcpy(e->value, str, len + 1);
+        } else if (!(e->value = intern_get(str, len))) {
+            /* Drop the references taken so far, then the block goes */
+            element_t *done, *safe;
+            list_for_each_entry_safe (done, safe, batch, list)
+                intern_put(done->value);
+            INIT_LIST_HEAD(batch);
+            free(blk);
+            return false;
+        }
+        e->len = len;
+        e->bulk = 1;
+        e->prefix = value_prefix(str, len);
+        if (tail)
+            list_add_tail(&e->list, batch);
+        else
+            list_add(&e->list, batch);
+        p += bulk_record_size(len);
+    }
+    return true;
+}
+
+/* Build elements referring to the strings of @pool at @offsets on @batch */
+static bool view_new(struct list_head *batch,
+                     const char *pool,
+                     const uint64_t *offsets,
+                     int n,
+                     q_view_t *view)
+{
+    const size_t rec = sizeof(bulk_block_t *) + sizeof(element_t);
+    bulk_block_t *blk = malloc(sizeof(bulk_block_t) + rec * n);
+    if (!blk)
+        return false;
+
+    char *p = (char *) (blk + 1);
+    for (int i = 0; i < n; i++, p += rec) {
+        const char *str = pool + offsets[i];
+        size_t len = strlen(str);
+        if (len > INT32_MAX) {
+            free(blk);
+            INIT_LIST_HEAD(batch);
+            return false;
+        }
+        *(bulk_block_t **) p = blk;
+        element_t *e = (element_t *) (p + sizeof(bulk_block_t *));
+        e->value = (char *) str;
+        e->len = len;
+        e->bulk = 1;
+        e->prefix = value_prefix(str, len);
+        list_add_tail(&e->list, batch);
+    }
+    blk->live = n;
+    blk->view = view;
+    view->refs++;
+    return true;
+}
+
+/* Put the @n elements on @batch at the head or the tail of queue */
+static bool q_put_batch(struct list_head *head,
+                        struct list_head *batch,
+                        int n,
+                        bool tail)
+{
+    queue_t *q = to_queue(head);
+    if (q->backend == Q_LIST) {
+        if (tail)
+            list_splice_tail(batch, head);
+        else
+            list_splice(batch, head);
+    } else if (q->backend == Q_RING) {
+        if (!ring_reserve(&q->ring, n))
+            return false;
+        struct list_head *node;
+        if (tail) {
+            list_for_each (node, batch)
+                ring_push_back(&q->ring, list_entry(node, element_t, list));
+        } else {
+            for (node = batch->prev; node != batch; node = node->prev)
+                ring_push_front(&q->ring, list_entry(node, element_t, list));
+        }
+        set_ends(q);
+    } else {
+        /* A chunk may be missing halfway, so be ready to back out */
+        int pushed = 0;
+        struct list_head *node = tail ? batch->next : batch->prev;
+        for (; node != batch; node = tail ? node->next : node->prev) {
+            element_t *e = list_entry(node, element_t, list);
+            if (!(tail ? deque_push_back(&q->chunks, e)
+                       : deque_push_front(&q->chunks, e)))
+                break;
+            pushed++;
+        }
+        if (pushed < n) {
+            while (pushed--) {
+                if (tail)
+                    deque_pop_back(&q->chunks);
+                else
+                    deque_pop_front(&q->chunks);
+            }
+            set_ends(q);
+            return false;
+        }
+        set_ends(q);
+    }
+    q->size += n;
+    reserve_scratch(q);
+    return true;
+}
+
+/* Put a batch of new elements into queue, releasing them if that fails */
+static bool q_put_new_batch(struct list_head *head,
+                            struct list_head *batch,
+                            int n,
+                            bool tail)
+{
+    if (q_put_batch(head, batch, n, tail))
+        return true;
+    element_t *e, *safe;
+    list_for_each_entry_safe (e, safe, batch, list)
+        q_release_element(e);
+    return false;
+}
+
+/* Insert @n elements holding the strings of @s in turn, see queue.h */
+static bool q_insert_bulk(struct list_head *head,
+                          char **s,
+                          int cnt,
+                          int n,
+                          bool tail)
+{
+    if (!head || !s || cnt < 1 || n < 0)
+        return false;
+    if (!n)
+        return true;
+
+    LIST_HEAD(batch);
+    if (!bulk_new(&batch, s, cnt, n, tail))
+        return false;
+    return q_put_new_batch(head, &batch, n, tail);
+}
+
+/* Copy the string of @e into @sp, truncated to fit @bufsize bytes. Only the
+ * bytes of the string are written, not the rest of the buffer.
+ */
+static void element_copy(const element_t *e, char *sp, size_t bufsize)
+{
+    if (!sp || !bufsize)
+        return;
+    size_t len = e->len < bufsize - 1 ? e->len : bufsize - 1;
+    memcpy(sp, e->value, len);
+    sp[len] = '\0';
+}
+
+/* Whether two elements hold the same string, the lengths telling most
+ * different ones apart
+ */
+static inline bool element_equal(const element_t *a, const element_t *b)
+{
+    return a->len == b->len && a->prefix == b->prefix &&
+           (a->value == b->value || !memcmp(a->value, b->value, a->len));
+}
+
+/* Add @e at the head or the tail of queue */
+static bool q_put(struct list_head *head, element_t *e, bool tail)
+{
+    queue_t *q = to_queue(head);
+    if (q->backend == Q_CHUNKED) {
+        if (!(tail ? deque_push_back(&q->chunks, e)
+                   : deque_push_front(&q->chunks, e)))
+            return false;
+        set_ends(q);
+    } else if (q->backend == Q_RING) {
+        if (!(tail ? ring_push_back(&q->ring, e)
+                   : ring_push_front(&q->ring, e)))
+            return false;
+        set_ends(q);
+    } else if (tail) {
+        list_add_tail(&e->list, head);
+    } else {
+        list_add(&e->list, head);
+    }
+    q->size++;
+    reserve_scratch(q);
+    return true;
+}
+
+/* Unlink the element at the head or the tail of a queue that is not empty */
+static element_t *q_take(struct list_head *head, bool tail)
+{
+    queue_t *q = to_queue(head);
+    element_t *e;
+    if (q->backend == Q_CHUNKED) {
+        e = tail ? deque_pop_back(&q->chunks) : deque_pop_front(&q->chunks);
+        set_ends(q);
+    } else if (q->backend == Q_RING) {
+        e = tail ? ring_pop_back(&q->ring) : ring_pop_front(&q->ring);
+        set_ends(q);
+    } else {
+        e = list_entry(tail ? head->prev : head->next, element_t, list);
+        list_del(&e->list);
+    }
+    q->size--;
+    return e;
+}
+
+/* Unlink up to @n elements from the head or the tail of queue in one go */
+static int q_take_n(struct list_head *head, element_t **elems, int n, bool tail)
+{
+    queue_t *q = to_queue(head);
+    if (n > q->size)
+        n = q->size;
+    if (n <= 0)
+        return 0;
+
+    if (q->backend == Q_CHUNKED) {
+        for (int i = 0; i < n; i++)
+            elems[i] = tail ? deque_pop_back(&q->chunks)
+                            : deque_pop_front(&q->chunks);
+        set_ends(q);
+    } else if (q->backend == Q_RING) {
+        for (int i = 0; i < n; i++)
+            elems[i] =
+                tail ? ring_pop_back(&q->ring) : ring_pop_front(&q->ring);
+        set_ends(q);
+    } else {
+        /* Collect the run, then cut it out with a single relink */
+        struct list_head *node = head;
+        for (int i = 0; i < n; i++) {
+            node = tail ? node->prev : node->next;
+            elems[i] = list_entry(node, element_t, list);
+        }
+        if (tail) {
+            head->prev = node->prev;
+            node->prev->next = head;
+        } else {
+            head->next = node->next;
+            node->next->prev = head;
+        }
+    }
+    q->size -= n;
+    return n;
 }
 
 /* Insert an element at head of queue */
@@ -42,34 +539,58 @@ bool q_insert_head(struct list_head *head, char *s)
 {
     if (!head)
         return false;
-    element_t *element_node = malloc(sizeof(element_t));
-    if (element_node == NULL)
+    element_t *element_node = element_new(s);
+    if (!element_node)
         return false;
-    element_node->value = strdup(s);
-    if (!element_node->value) {
-        free(element_node);
+    if (!q_put(head, element_node, false)) {
+        q_release_element(element_node);
         return false;
     }
-    struct list_head *list_node = &element_node->list;
-    list_add(list_node, head);
     return true;
 }
 
+/* Insert many elements at head of queue */
+bool q_insert_head_bulk(struct list_head *head, char **s, int cnt, int n)
+{
+    return q_insert_bulk(head, s, cnt, n, false);
+}
+
+/* Insert many elements at tail of queue */
+bool q_insert_tail_bulk(struct list_head *head, char **s, int cnt, int n)
+{
+    return q_insert_bulk(head, s, cnt, n, true);
+}
+
+/* Insert @n elements referring to strings in place, see queue.h */
+bool q_insert_tail_view(struct list_head *head,
+                        const char *pool,
+                        const uint64_t *offsets,
+                        int n,
+                        q_view_t *view)
+{
+    if (!head || !pool || !offsets || !view || n < 0)
+        return false;
+    if (!n)
+        return true;
+
+    LIST_HEAD(batch);
+    if (!view_new(&batch, pool, offsets, n, view))
+        return false;
+    return q_put_new_batch(head, &batch, n, true);
+}
+
 /* Insert an element at tail of queue */
 bool q_insert_tail(struct list_head *head, char *s)
 {
     if (!head)
         return false;
-    element_t *element_node = malloc(sizeof(element_t));
-    if (element_node == NULL)
+    element_t *element_node = element_new(s);
+    if (!element_node)
         return false;
-    element_node->value = strdup(s);
-    if (!element_node->value) {
-        free(element_node);
+    if (!q_put(head, element_node, true)) {
+        q_release_element(element_node);
         return false;
     }
-    struct list_head *list_node = &element_node->list;
-    list_add_tail(list_node, head);
     return true;
 }
 /* Remove an element from head of queue */
@@ -78,13 +599,8 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
     if (!head || list_empty(head))
         return NULL;
 
-    struct list_head *list_node = head->next;
-    element_t *element_node = list_entry(list_node, element_t, list);
-    list_del(list_node);
-    if (sp) {
-        strncpy(sp, element_node->value, bufsize);
-        sp[bufsize - 1] = '\0';
-    }
+    element_t *element_node = q_take(head, false);
+    element_copy(element_node, sp, bufsize);
     return element_node;
 }
 
@@ -94,28 +610,49 @@ element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
     if (!head || list_empty(head))
         return NULL;
 
-    struct list_head *list_node = head->prev;
-    element_t *element_node = list_entry(list_node, element_t, list);
-    list_del(list_node);
-    if (sp) {
-        strncpy(sp, element_node->value, bufsize);
-        sp[bufsize - 1] = '\0';
-    }
+    element_t *element_node = q_take(head, true);
+    element_copy(element_node, sp, bufsize);
     return element_node;
 }
 
+/* Remove up to @n elements from head of queue */
+int q_remove_head_n(struct list_head *head,
+                    element_t **elems,
+                    char **sp,
+                    size_t bufsize,
+                    int n)
+{
+    if (!head || !elems)
+        return 0;
+
+    int removed = q_take_n(head, elems, n, false);
+    for (int i = 0; sp && i < removed; i++)
+        element_copy(elems[i], sp[i], bufsize);
+    return removed;
+}
+
+/* Remove up to @n elements from tail of queue */
+int q_remove_tail_n(struct list_head *head,
+                    element_t **elems,
+                    char **sp,
+                    size_t bufsize,
+                    int n)
+{
+    if (!head || !elems)
+        return 0;
+
+    int removed = q_take_n(head, elems, n, true);
+    for (int i = 0; sp && i < removed; i++)
+        element_copy(elems[i], sp[i], bufsize);
+    return removed;
+}
+
 /* Return number of elements in queue */
 int q_size(struct list_head *head)
 {
-    if (!head || list_empty(head))
+    if (!head)
         return 0;
-
-    size_t length = 0;
-    struct list_head *node;
-    list_for_each (node, head) {
-        length++;
-    }
-    return length;
+    return to_queue(head)->size;
 }
 
 /* Delete the middle node in queue */
@@ -123,15 +660,37 @@ bool q_delete_mid(struct list_head *head)
 {
     if (!head || list_empty(head))
         return false;
-    struct list_head *slow = head->next;
-    struct list_head *fast = head->next;
-    while (fast != head && fast->next != head) {
-        slow = slow->next;
-        fast = fast->next->next;
+
+    queue_t *q = to_queue(head);
+    int mid = q->size / 2;
+    if (q->backend == Q_CHUNKED) {
+        q_release_element(deque_remove_at(&q->chunks, mid));
+        q->size--;
+        set_ends(q);
+        return true;
+    }
+    if (q->backend == Q_RING) {
+        q_release_element(ring_remove_at(&q->ring, mid));
+        q->size--;
+        set_ends(q);
+        return true;
+    }
+
+    /* The size is known, so walk from whichever end is closer */
+    struct list_head *node;
+    if (mid < q->size - mid) {
+        node = head->next;
+        for (int i = 0; i < mid; i++)
+            node = node->next;
+    } else {
+        node = head->prev;
+        for (int i = q->size - 1; i > mid; i--)
+            node = node->prev;
     }
 
-    list_del_init(slow);
-    element_t *element_node = list_entry(slow, element_t, list);
+    list_del_init(node);
+    q->size--;
+    element_t *element_node = list_entry(node, element_t, list);
     q_release_element(element_node);
 
     return true;
@@ -140,46 +699,120 @@ bool q_delete_mid(struct list_head *head)
 /* Delete all nodes that have duplicate string */
 bool q_delete_dup(struct list_head *head)
 {
+    q_link(head);
     if (!head || list_empty(head))
         return false;
 
-    struct list_head *cur = head->next;
-    struct list_head *next = NULL;
-    char pre_val[1024] = {0};
-    char cur_val[1024] = {0};
-    char next_val[1024] = {0};
+    /* Runs of equal strings are unlinked whole and collected here, so each
+     * node is compared once and the list is rewired once per run.
+     */
+    LIST_HEAD(garbage);
+    int removed = 0;
 
-    while (cur != head) {
-        next = cur->next;
-        element_t *element_node_cur = list_entry(cur, element_t, list);
-        strncpy(cur_val, element_node_cur->value,
-                strlen(element_node_cur->value));
-
-        if (next != head) {
-            element_t *element_node_next = list_entry(next, element_t, list);
-            strncpy(next_val, element_node_next->value,
-                    strlen(element_node_next->value));
-        } else {
-            next_val[0] = '\0';
+    struct list_head *first = head->next;
+    while (first != head) {
+        const element_t *e = list_entry(first, element_t, list);
+        struct list_head *last = first;
+        int run = 1;
+        while (last->next != head &&
+               element_equal(list_entry(last->next, element_t, list), e)) {
+            last = last->next;
+            run++;
         }
 
-        if (strncmp(pre_val, cur_val, strlen(cur_val)) == 0 ||
-            strncmp(cur_val, next_val, strlen(cur_val)) == 0) {
-            list_del_init(cur);
-            element_t *element_node_del = list_entry(cur, element_t, list);
-            q_release_element(element_node_del);
+        struct list_head *next = last->next;
+        if (run > 1) {
+            first->prev->next = next;
+            next->prev = first->prev;
+
+            first->prev = garbage.prev;
+            garbage.prev->next = first;
+            last->next = &garbage;
+            garbage.prev = last;
+            removed += run;
         }
+        first = next;
+    }
+    to_queue(head)->size -= removed;
 
-        strncpy(pre_val, cur_val, strlen(cur_val));
-        cur = next;
+    element_t *e, *safe;
+    list_for_each_entry_safe (e, safe, &garbage, list)
+        q_release_element(e);
+
+    q_store(head);
+    return true;
+}
+
+/* Slot of the table used by q_delete_dup_hash() */
+typedef struct {
+    element_t *first; /* first element holding the string, NULL if unused */
+    uint32_t tag;     /* upper half of the hash, to skip most comparisons */
+    bool dup;
+} dup_slot_t;
+
+/* Delete all nodes whose string occurs more than once, in any order */
+bool q_delete_dup_hash(struct list_head *head)
+{
+    if (!head)
+        return false;
+    q_link(head);
+    queue_t *q = to_queue(head);
+    if (!q->size)
+        return false;
+
+    /* Keep the load factor at or below one half */
+    size_t cap = 2;
+    while (cap < 2 * (size_t) q->size)
+        cap <<= 1;
+    dup_slot_t *table = malloc(sizeof(dup_slot_t) * cap);
+    if (!table)
+        return false;
+    memset(table, 0, sizeof(dup_slot_t) * cap);
+
+    /* Later occurrences go right away, first occurrences once all are seen */
+    LIST_HEAD(garbage);
+    int removed = 0;
+    size_t mask = cap - 1;
+    struct list_head *node, *safe;
+    list_for_each_safe (node, safe, head) {
+        element_t *e = list_entry(node, element_t, list);
+        uint64_t hash = hash_bytes(e->value, e->len, 0);
+        uint32_t tag = hash >> 32;
+        size_t i = hash & mask;
+        while (table[i].first && (table[i].tag != tag ||
+                                  !element_equal(table[i].first, e)))
+            i = (i + 1) & mask;
+
+        if (!table[i].first) {
+            table[i].tag = tag;
+            table[i].first = e;
+        } else {
+            table[i].dup = true;
+            list_move_tail(node, &garbage);
+            removed++;
+        }
+    }
+    for (size_t i = 0; i < cap; i++) {
+        if (table[i].dup) {
+            list_move_tail(&table[i].first->list, &garbage);
+            removed++;
+        }
     }
+    free(table);
+    q->size -= removed;
+
+    element_t *e, *tmp;
+    list_for_each_entry_safe (e, tmp, &garbage, list)
+        q_release_element(e);
 
+    q_store(head);
     return true;
 }
 
 /* Swap every two adjacent nodes */
 void q_swap(struct list_head *head)
 {
+    q_link(head);
     if (!head || list_empty(head))
         return;
     struct list_head *pre = head;
@@ -194,6 +827,7 @@ void q_swap(struct list_head *head)
         cur = cur->next;
         next = cur->next;
     }
+    q_store(head);
 }
 
 /* Reverse elements in queue */
@@ -212,6 +846,21 @@ void q_reverse(struct list_head *head)
 {
     if (!head || list_empty(head))
         return;
+
+    /* Chunks are reversed without touching the elements, and a ring is
+     * merely read the other way around
+     */
+    queue_t *q = to_queue(head);
+    if (q->backend == Q_CHUNKED) {
+        deque_reverse(&q->chunks);
+        set_ends(q);
+        return;
+    }
+    if (q->backend == Q_RING) {
+        ring_reverse(&q->ring);
+        set_ends(q);
+        return;
+    }
     q_reverse_range(head, head);
 }
 
@@ -221,6 +870,16 @@ void q_reverseK(struct list_head *head, int k)
     if (!head || list_empty(head))
         return;
 
+    /* A ring swaps the pointers within each group in place */
+    queue_t *q = to_queue(head);
+    if (q->backend == Q_RING) {
+        ring_reverse_k(&q->ring, k);
+        set_ends(q);
+        return;
+    }
+
+    q_link(head);
+
     int count = 0;
     struct list_head *start = head;
     struct list_head *node = NULL, *safe = NULL;
@@ -231,183 +890,232 @@ void q_reverseK(struct list_head *head, int k)
             start = safe->prev;
         }
     }
+    q_store(head);
 }
 
 /* Sort elements of queue in ascending/descending order */
-/*need to break list1 and list2 from circular list to oneway list first*/
-struct list_head *mergeTwoLists(struct list_head *list1,
-                                struct list_head *list2,
-                                struct list_head **tail,
-                                bool descend)
-{
-    struct list_head *ret = NULL;
-    struct list_head *prev = NULL;
-    struct list_head **ptr = &ret;
-    for (; list1 != NULL && list2 != NULL; ptr = &(*ptr)->next) {
-        element_t *element_node1 = list_entry(list1, element_t, list);
-        element_t *element_node2 = list_entry(list2, element_t, list);
-
-        int compare_result = strcmp(element_node1->value, element_node2->value);
-        if (descend)
-            compare_result *= -1;
-
-        if (compare_result < 0) {
-            *ptr = list1;
-            list1->prev = prev;
-            prev = list1;
-            list1 = list1->next;
-        } else {
-            *ptr = list2;
-            list2->prev = prev;
-            prev = list2;
-            list2 = list2->next;
-        }
-    }
-
-    if (list1 == NULL) {
-        *ptr = list2;
-        list2->prev = prev;
-        *tail = list2;
-    } else {
-        *ptr = list1;
-        list1->prev = prev;
-        *tail = list1;
-    }
-    while ((*tail)->next != NULL)
-        *tail = (*tail)->next;
-    return ret;
-}
-
-struct list_head *sortList(struct list_head *node,
-                           struct list_head **tail,
-                           bool descend)
-{
-    if (node == NULL || node->next == NULL)
-        return node;
-    struct list_head *slow = node;
-    struct list_head *fast = node->next;
-    while (fast != NULL && fast->next != NULL) {
-        slow = slow->next;
-        fast = fast->next->next;
-    }
-
-    struct list_head *list1 = sortList(slow->next, tail, descend);
-    slow->next = NULL;
-    struct list_head *list2 = sortList(node, tail, descend);
-
-    return mergeTwoLists(list1, list2, tail, descend);
-}
 void q_sort(struct list_head *head, bool descend)
 {
+    q_link(head);
     if (!head || list_empty(head) || list_is_singular(head))
         return;
 
+    queue_t *q = to_queue(head);
+    if (sort_algo == SORT_ARRAY && q->scratch_cap >= q->size) {
+        sort_array(head, q->scratch, q->size, descend);
+        q_store(head);
+        return;
+    }
+
     head->prev->next = NULL;  // break the circular list at first
+    struct list_head *list = sort_list(head->next, q->size, descend);
 
-    struct list_head *tail = NULL;
-    struct list_head *ret = sortList(head->next, &tail, descend);
-    head->next = ret;
-    ret->prev = head;
-    head->prev = tail;
-    tail->next = head;
+    /* The engines only maintain ->next, so restore ->prev in one pass */
+    struct list_head *prev = head;
+    for (struct list_head *node = list; node; node = node->next) {
+        node->prev = prev;
+        prev->next = node;
+        prev = node;
+    }
+    prev->next = head;
+    head->prev = prev;
+    q_store(head);
 }
 
-/* Remove every node which has a node with a strictly less value anywhere to
- * the right side of it */
-int q_ascend(struct list_head *head)
+/* Walk from the tail, keeping a pointer to the extreme of the nodes already
+ * passed. A node the extreme beats is moved aside and all of them are
+ * released once the walk is over.
+ */
+static int q_monotonic(struct list_head *head, bool descend)
 {
-    if (!head || list_empty(head) || list_is_singular(head))
-        return q_size(head);
-    char max_string[1024] = {0};
-    struct list_head *cur = head->next;
-    struct list_head *next = NULL;
+    if (!head)
+        return 0;
+    queue_t *q = to_queue(head);
+    if (q->size < 2)
+        return q->size;
 
-    while (cur != head) {
-        next = cur->next;
-        element_t *element_node_cur = list_entry(cur, element_t, list);
-        if (strcmp(max_string, element_node_cur->value) <=
-            0) /*max_string is less or equal than cur string*/
-        {
-            strncpy(max_string, element_node_cur->value,
-                    strlen(element_node_cur->value));
-        } else /*max_string is greater then the cur string*/
-        {
-            list_del_init(cur);
-            q_release_element(element_node_cur);
+    q_link(head);
+    LIST_HEAD(garbage);
+    const element_t *extreme = list_entry(head->prev, element_t, list);
+    int kept = 1;
+    struct list_head *cur, *prev;
+    for (cur = head->prev->prev; cur != head; cur = prev) {
+        prev = cur->prev;
+        element_t *e = list_entry(cur, element_t, list);
+        int cmp = q_element_cmp(e, extreme);
+        if (descend ? cmp < 0 : cmp > 0) {
+            list_move(cur, &garbage);
+        } else {
+            extreme = e;
+            kept++;
         }
-        cur = next;
     }
+    q->size = kept;
+
+    element_t *e, *tmp;
+    list_for_each_entry_safe (e, tmp, &garbage, list)
+        q_release_element(e);
 
+    q_store(head);
+    return kept;
+}
 
-    return q_size(head);
+/* Remove every node which has a node with a strictly less value anywhere to
+ * the right side of it */
+int q_ascend(struct list_head *head)
+{
+    return q_monotonic(head, false);
 }
 
 /* Remove every node which has a node with a strictly greater value anywhere to
  * the right side of it */
 int q_descend(struct list_head *head)
 {
-    if (!head || list_empty(head) || list_is_singular(head))
-        return q_size(head);
-    char max_string[1024] = {0};
-    struct list_head *cur = head->prev;
-    struct list_head *next = NULL;
+    return q_monotonic(head, true);
+}
 
-    while (cur != head) {
-        next = cur->prev;
-        element_t *element_node_cur = list_entry(cur, element_t, list);
-        if (strcmp(max_string, element_node_cur->value) <=
-            0) /*max_string is less or equal than cur string*/
-        {
-            strncpy(max_string, element_node_cur->value,
-                    strlen(element_node_cur->value));
-        } else /*max_string is greater then the cur string*/
-        {
-            list_del_init(cur);
-            q_release_element(element_node_cur);
-        }
-        cur = next;
+/* Compare the strings of two elements in the requested order */
+static inline int element_cmp(const struct list_head *a,
+                              const struct list_head *b,
+                              bool descend)
+{
+    int ret = q_element_cmp(list_entry(a, element_t, list),
+                            list_entry(b, element_t, list));
+    return descend ? -ret : ret;
+}
+
+/* q_merge() keeps the queues that still have elements in a pairing heap keyed
+ * by their first element. The links live in queue_t, so building the heap
+ * needs no allocation.
+ */
+static queue_t *heap_meld(queue_t *a, queue_t *b, bool descend)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+    if (element_cmp(b->head.next, a->head.next, descend) < 0) {
+        queue_t *tmp = a;
+        a = b;
+        b = tmp;
     }
+    b->sibling = a->child;
+    a->child = b;
+    return a;
+}
 
+/* Remove the root and meld its children back together, two passes */
+static queue_t *heap_pop(queue_t *root, bool descend)
+{
+    queue_t *pairs = NULL, *sub = root->child;
+    root->child = NULL;
 
-    return q_size(head);
+    /* Meld children pairwise from left to right, stacking the results */
+    while (sub) {
+        queue_t *a = sub, *b = sub->sibling;
+        sub = b ? b->sibling : NULL;
+        a->sibling = NULL;
+        if (b) {
+            b->sibling = NULL;
+            a = heap_meld(a, b, descend);
+        }
+        a->sibling = pairs;
+        pairs = a;
+    }
+
+    /* Then meld the stacked pairs from right to left */
+    queue_t *heap = NULL;
+    while (pairs) {
+        queue_t *next = pairs->sibling;
+        pairs->sibling = NULL;
+        heap = heap_meld(heap, pairs, descend);
+        pairs = next;
+    }
+    return heap;
 }
 
 /* Merge all the queues into one sorted queue, which is in ascending/descending
- * order */
+ * order. Each step moves the smallest front element out of the heap of queues,
+ * so every node is unlinked and relinked exactly once, O(N log k) in total.
+ */
 int q_merge(struct list_head *head, bool descend)
 {
     if (!head || list_empty(head))
         return 0;
 
-    struct list_head *forward = NULL;
-    struct list_head *backward = head->prev;
-    struct list_head *tail = NULL;
-    while (backward != head->next) {
-        forward = head->next;
-        while (forward != backward && backward->next != forward) {
-            queue_contex_t *forward_head =
-                list_entry(forward, queue_contex_t, chain);
-            queue_contex_t *backward_head =
-                list_entry(backward, queue_contex_t, chain);
-            struct list_head *head1 = forward_head->q;
-            struct list_head *head2 = backward_head->q;
-            head1->prev->next = NULL;  // break the cicular first
-            head2->prev->next = NULL;
-            struct list_head *list1 = head1->next;
-            struct list_head *list2 = head2->next;
-            struct list_head *ret = mergeTwoLists(list1, list2, &tail, descend);
-            head1->next = ret;
-            ret->prev = head1;
-            head1->prev = tail;
-            tail->next = head1;
-
-            INIT_LIST_HEAD(backward_head->q);
-            backward = backward->prev;
-            forward = forward->next;
-        }
+    struct list_head *first = list_first_entry(head, queue_contex_t, chain)->q;
+    if (!first)
+        return 0;
+
+    queue_t *heap = NULL;
+    queue_contex_t *ctx;
+    list_for_each_entry (ctx, head, chain) {
+        q_link(ctx->q);
+        if (!ctx->q || list_empty(ctx->q))
+            continue;
+        queue_t *q = to_queue(ctx->q);
+        q->size = 0;
+        q->child = q->sibling = NULL;
+        heap = heap_meld(heap, q, descend);
     }
 
-    struct list_head *first = head->next;
-    queue_contex_t *first_head = list_entry(first, queue_contex_t, chain);
-    return q_size(first_head->q);
+    LIST_HEAD(merged);
+    int size = 0;
+    while (heap) {
+        queue_t *q = heap;
+        heap = heap_pop(q, descend);
+
+        /* Keep draining this queue while it is no larger than the rest */
+        do {
+            list_move_tail(q->head.next, &merged);
+            size++;
+        } while (!list_empty(&q->head) &&
+                 (!heap ||
+                  element_cmp(q->head.next, heap->head.next, descend) <= 0));
+
+        if (!list_empty(&q->head))
+            heap = heap_meld(heap, q, descend);
+    }
+
+    list_splice(&merged, first);
+    to_queue(first)->size = size;
+
+    /* The chunks of the emptied queues make room for the merged elements,
+     * and so does the largest buffer among the emptied ring queues. Should
+     * they still fall short, as when list queues are merged into a chunked
+     * or ring one, the first queue turns into a list queue, since allocation
+     * is not an option here.
+     */
+    queue_t *fq = to_queue(first);
+    list_for_each_entry (ctx, head, chain) {
+        if (!ctx->q || ctx->q == first)
+            continue;
+        queue_t *q = to_queue(ctx->q);
+        if (q->backend == Q_RING) {
+            if (fq->backend == Q_RING && q->ring.cap > fq->ring.cap) {
+                ring_t tmp = fq->ring;
+                fq->ring = q->ring;
+                q->ring = tmp;
+            }
+            ring_clear(&q->ring);
+        } else if (q->backend == Q_CHUNKED) {
+            if (fq->backend == Q_CHUNKED)
+                deque_take_chunks(&fq->chunks, &q->chunks);
+            else
+                deque_clear(&q->chunks);
+        }
+    }
+    bool fits = true;
+    if (fq->backend == Q_CHUNKED)
+        fits = fq->chunks.chunks * DEQUE_SLOTS >= (size_t) size;
+    else if (fq->backend == Q_RING)
+        fits = fq->ring.cap >= (size_t) size;
+    if (fits) {
+        q_store(first);
+    } else {
+        deque_clear(&fq->chunks);
+        ring_clear(&fq->ring);
+        fq->backend = Q_LIST;
+    }
+    return size;
 }
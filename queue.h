@@ -9,22 +9,60 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "harness.h"
+#include "intern.h"
 #include "list.h"
 
 /**
  * element_t - Linked list element
  * @value: pointer to array holding string
  * @list: node of a doubly-linked list
- *
- * @value needs to be explicitly allocated and freed
+ * @len: length of @value, cached so that the string is never scanned for it
+ * @bulk: whether the element shares its block with the other elements of a
+ *        bulk insertion, see q_insert_head_bulk()
+ * @prefix: first Q_PREFIX_BYTES bytes of @value, most significant first and
+ *          padded with zeros, so that integer order is string order
+ *
+ * @value is normally stored right behind the element in the same allocation,
+ * so that an insertion costs a single call to malloc. A @value that does not
+ * share the element's block is interned, see q_intern, and shared with the
+ * other elements holding the same string, or belongs to a q_view_t.
  */
 typedef struct {
     char *value;
     struct list_head list;
+    uint32_t len : 31;
+    uint32_t bulk : 1;
+    uint32_t prefix;
 } element_t;
 
+#define Q_PREFIX_BYTES sizeof(uint32_t)
+
+/**
+ * q_element_cmp() - Compare the strings of two elements
+ * @a: first element
+ * @b: second element
+ *
+ * The prefixes settle most comparisons without touching the strings.
+ *
+ * Return: less than, equal to, or greater than zero, as strcmp() would
+ */
+static inline int q_element_cmp(const element_t *a, const element_t *b)
+{
+    if (a->prefix != b->prefix)
+        return a->prefix < b->prefix ? -1 : 1;
+
+    /* Equal prefixes padded with a zero hold whole strings */
+    if (!(a->prefix & 0xff) || a->value == b->value)
+        return 0;
+    uint32_t len = a->len < b->len ? a->len : b->len;
+    return memcmp(a->value + Q_PREFIX_BYTES, b->value + Q_PREFIX_BYTES,
+                  len + 1 - Q_PREFIX_BYTES);
+}
+
 /**
  * queue_contex_t - The context managing a chain of queues
  * @q: pointer to the head of the queue
@@ -39,6 +77,33 @@ typedef struct {
     int id;
 } queue_contex_t;
 
+/**
+ * q_backend_t - Ways a queue can hold its elements
+ * @Q_LIST: elements linked into the circular doubly-linked list at the head
+ * @Q_CHUNKED: pointers to the elements kept in chunks of a few cache lines
+ * @Q_RING: pointers to the elements kept in a ring buffer that doubles as
+ *          it fills up
+ *
+ * Whatever the backend, q_new() hands out a list head, operations return
+ * element_t, and @head->next and @head->prev point at the first and last
+ * element. Only Q_LIST keeps the links between elements up to date; for the
+ * others, call q_link() before walking the list.
+ */
+typedef enum {
+    Q_LIST,
+    Q_CHUNKED,
+    Q_RING,
+    N_Q_BACKEND,
+} q_backend_t;
+
+/* Backend of the queues q_new() creates, one of q_backend_t */
+extern int q_backend;
+
+/* Whether insertions intern their strings instead of copying them. Elements
+ * with either kind of value may share a queue, so this can change any time.
+ */
+extern int q_intern;
+
 /* Operations on queue */
 
 /**
@@ -48,6 +113,15 @@ typedef struct {
  */
 struct list_head *q_new();
 
+/**
+ * q_link() - Link the elements of queue in order, from @head around to @head
+ * @head: header of queue
+ *
+ * The links stay valid until the queue is modified. No effect if header is
+ * NULL or the queue keeps its list up to date anyway.
+ */
+void q_link(struct list_head *head);
+
 /**
  * q_free() - Free all storage used by queue, no effect if header is NULL
  * @head: header of queue
@@ -78,6 +152,72 @@ bool q_insert_head(struct list_head *head, char *s);
  */
 bool q_insert_tail(struct list_head *head, char *s);
 
+/**
+ * q_insert_head_bulk() - Insert many elements at the head
+ * @head: header of queue
+ * @s: strings to be inserted
+ * @cnt: number of strings in @s
+ * @n: number of elements to insert, the i-th of which holds @s[i % @cnt]
+ *
+ * The result is that of @n calls to q_insert_head(), but the elements and
+ * their strings are allocated as one block and put into the queue at once.
+ * The block counts its elements still alive and is freed along with the last
+ * of them. Until then, releasing an element frees nothing: the whole block
+ * stays allocated as long as any one of its elements is in use.
+ *
+ * Return: true for success, false for allocation failed or queue is NULL, in
+ * which case queue is unchanged
+ */
+bool q_insert_head_bulk(struct list_head *head, char **s, int cnt, int n);
+
+/**
+ * q_insert_tail_bulk() - Insert many elements at the tail
+ * @head: header of queue
+ * @s: strings to be inserted
+ * @cnt: number of strings in @s
+ * @n: number of elements to insert, the i-th of which holds @s[i % @cnt]
+ *
+ * The result is that of @n calls to q_insert_tail(), with the allocation done
+ * as in q_insert_head_bulk().
+ *
+ * Return: true for success, false for allocation failed or queue is NULL, in
+ * which case queue is unchanged
+ */
+bool q_insert_tail_bulk(struct list_head *head, char **s, int cnt, int n);
+
+/**
+ * q_view_t - Owner of strings that elements refer to in place
+ * @refs: references to the strings, one per block of elements holding them
+ *        and one for the owner itself while it is inserting
+ * @release: called once @refs drops to zero, to dispose of the strings
+ */
+typedef struct q_view {
+    size_t refs;
+    void (*release)(struct q_view *view);
+} q_view_t;
+
+/**
+ * q_insert_tail_view() - Insert many elements whose strings stay in place
+ * @head: header of queue
+ * @pool: null-terminated strings, which must outlive the elements
+ * @offsets: where the string of each element starts in @pool
+ * @n: number of elements to insert
+ * @view: owner of @pool
+ *
+ * The elements are allocated as one block, as in q_insert_head_bulk(), but
+ * they point into @pool instead of holding a copy of their string, whether
+ * or not q_intern is set. The block takes a reference to @view and drops it
+ * along with its last element.
+ *
+ * Return: true for success, false for allocation failed or queue is NULL, in
+ * which case queue is unchanged
+ */
+bool q_insert_tail_view(struct list_head *head,
+                        const char *pool,
+                        const uint64_t *offsets,
+                        int n,
+                        q_view_t *view);
+
 /**
  * q_remove_head() - Remove the element from head of queue
  * @head: header of queue
@@ -108,6 +248,48 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize);
  */
 element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize);
 
+/**
+ * q_remove_head_n() - Remove up to @n elements from head of queue
+ * @head: header of queue
+ * @elems: array receiving the removed elements, in the order of removal
+ * @sp: array of @n buffers receiving the strings as q_remove_head() would,
+ *      or NULL
+ * @bufsize: size of each buffer
+ * @n: number of elements to remove
+ *
+ * The queue is updated once for the whole batch instead of once per element.
+ * The caller still releases each element.
+ *
+ * Return: the number of elements removed, less than @n if queue ran out.
+ */
+int q_remove_head_n(struct list_head *head,
+                    element_t **elems,
+                    char **sp,
+                    size_t bufsize,
+                    int n);
+
+/**
+ * q_remove_tail_n() - Remove up to @n elements from tail of queue
+ * @head: header of queue
+ * @elems: array receiving the removed elements, in the order of removal
+ * @sp: array of @n buffers receiving the strings as q_remove_tail() would,
+ *      or NULL
+ * @bufsize: size of each buffer
+ * @n: number of elements to remove
+ *
+ * Return: the number of elements removed, less than @n if queue ran out.
+ */
+int q_remove_tail_n(struct list_head *head,
+                    element_t **elems,
+                    char **sp,
+                    size_t bufsize,
+                    int n);
+
+/* Release an element inserted by q_insert_head_bulk(), q_insert_tail_bulk() or
+ * q_insert_tail_view(), through q_release_element()
+ */
+void q_release_bulk(element_t *e);
+
 /**
  * q_release_element() - Release the element
  * @e: element would be released
@@ -116,7 +298,12 @@ element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize);
  */
 static inline void q_release_element(element_t *e)
 {
-    test_free(e->value);
+    if (e->bulk) {
+        q_release_bulk(e);
+        return;
+    }
+    if (e->value != (char *) (e + 1))
+        intern_put(e->value);
     test_free(e);
 }
 
@@ -155,6 +342,20 @@ bool q_delete_mid(struct list_head *head);
  */
 bool q_delete_dup(struct list_head *head);
 
+/**
+ * q_delete_dup_hash() - Delete all nodes whose string occurs more than once
+ *                       anywhere in the queue
+ * @head: header of queue
+ *
+ * Unlike q_delete_dup(), the queue does not have to be sorted. The strings are
+ * counted in a hash table allocated up front for the whole queue, and the
+ * remaining nodes keep their relative order.
+ *
+ * Return: true for success, false if list is NULL or empty, as for
+ * q_delete_dup(), or if the table could not be allocated.
+ */
+bool q_delete_dup_hash(struct list_head *head);
+
 /**
  * q_swap() - Swap every two adjacent nodes
  * @head: header of queue
@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "ring.h"
+
+/* Double the buffer of a ring until it holds @need items, laying the items
+ * out from slot 0 in their order
+ */
+static bool ring_grow(ring_t *r, size_t need)
+{
+    size_t cap = r->cap ? 2 * r->cap : RING_MIN;
+    while (cap < need)
+        cap *= 2;
+    void **slot = malloc(sizeof(void *) * cap);
+    if (!slot)
+        return false;
+
+    if (!r->reversed) {
+        /* The items wrap around at most once */
+        size_t head = r->cap - r->first;
+        if (head > r->size)
+            head = r->size;
+        memcpy(slot, &r->slot[r->first], head * sizeof(void *));
+        memcpy(&slot[head], r->slot, (r->size - head) * sizeof(void *));
+    } else {
+        for (size_t i = 0; i < r->size; i++)
+            slot[i] = ring_at(r, i);
+    }
+    free(r->slot);
+    r->slot = slot;
+    r->cap = cap;
+    r->first = 0;
+    r->reversed = false;
+    return true;
+}
+
+void ring_init(ring_t *r)
+{
+    r->slot = NULL;
+    r->cap = r->first = r->size = 0;
+    r->reversed = false;
+}
+
+void ring_destroy(ring_t *r)
+{
+    free(r->slot);
+    ring_init(r);
+}
+
+bool ring_reserve(ring_t *r, size_t n)
+{
+    return r->size + n <= r->cap || ring_grow(r, r->size + n);
+}
+
+bool ring_push_front(ring_t *r, void *item)
+{
+    if (r->size == r->cap && !ring_grow(r, r->size + 1))
+        return false;
+    r->first = ring_pos(r, -1);
+    r->slot[r->first] = item;
+    r->size++;
+    return true;
+}
+
+bool ring_push_back(ring_t *r, void *item)
+{
+    if (r->size == r->cap && !ring_grow(r, r->size + 1))
+        return false;
+    r->slot[ring_pos(r, r->size)] = item;
+    r->size++;
+    return true;
+}
+
+void *ring_pop_front(ring_t *r)
+{
+    if (!r->size)
+        return NULL;
+    void *item = r->slot[r->first];
+    r->first = ring_pos(r, 1);
+    r->size--;
+    return item;
+}
+
+void *ring_pop_back(ring_t *r)
+{
+    if (!r->size)
+        return NULL;
+    return r->slot[ring_pos(r, --r->size)];
+}
+
+void *ring_remove_at(ring_t *r, size_t i)
+{
+    void *item = ring_at(r, i);
+    if (i < r->size - 1 - i) {
+        for (; i > 0; i--)
+            r->slot[ring_pos(r, i)] = ring_at(r, i - 1);
+        r->first = ring_pos(r, 1);
+    } else {
+        for (; i < r->size - 1; i++)
+            r->slot[ring_pos(r, i)] = ring_at(r, i + 1);
+    }
+    r->size--;
+    return item;
+}
+
+void ring_reverse(ring_t *r)
+{
+    if (r->size)
+        r->first = ring_pos(r, r->size - 1);
+    r->reversed = !r->reversed;
+}
+
+void ring_reverse_k(ring_t *r, size_t k)
+{
+    if (k < 2)
+        return;
+    for (size_t start = 0; start + k <= r->size; start += k) {
+        for (size_t i = start, j = start + k - 1; i < j; i++, j--) {
+            size_t a = ring_pos(r, i), b = ring_pos(r, j);
+            void *tmp = r->slot[a];
+            r->slot[a] = r->slot[b];
+            r->slot[b] = tmp;
+        }
+    }
+}
+
+void ring_clear(ring_t *r)
+{
+    r->first = r->size = 0;
+    r->reversed = false;
+}
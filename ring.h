@@ -0,0 +1,119 @@
+#ifndef LAB0_RING_H
+#define LAB0_RING_H
+
+/* Double-ended queue of pointers kept in a ring buffer.
+ *
+ * The capacity is a power of two, so positions wrap with a mask instead of a
+ * division, and it doubles whenever the ring is full, which keeps pushing at
+ * either end O(1) amortized. The ring can be read in either direction: turning
+ * it around only flips a flag, so reversing the whole deque is O(1) too.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Capacity of a ring on its first push */
+#define RING_MIN 16
+
+/**
+ * ring_t - Deque of pointers in a ring buffer
+ * @slot: the buffer, NULL until the first push
+ * @cap: number of slots, zero or a power of two
+ * @first: slot of the first item
+ * @size: number of items
+ * @reversed: whether the items follow @first downwards instead of upwards
+ */
+typedef struct {
+    void **slot;
+    size_t cap;
+    size_t first;
+    size_t size;
+    bool reversed;
+} ring_t;
+
+/* Slot holding the item at index @i, which may also be -1 or @r->size */
+static inline size_t ring_pos(const ring_t *r, size_t i)
+{
+    return (r->reversed ? r->first - i : r->first + i) & (r->cap - 1);
+}
+
+/* Return the item at index @i, less than @r->size */
+static inline void *ring_at(const ring_t *r, size_t i)
+{
+    return r->slot[ring_pos(r, i)];
+}
+
+/* Return the first item, NULL if @r is empty */
+static inline void *ring_front(const ring_t *r)
+{
+    return r->size ? r->slot[r->first] : NULL;
+}
+
+/* Return the last item, NULL if @r is empty */
+static inline void *ring_back(const ring_t *r)
+{
+    return r->size ? ring_at(r, r->size - 1) : NULL;
+}
+
+/* Initialize an empty ring */
+void ring_init(ring_t *r);
+
+/* Free the buffer of @r, which is left empty. The items are not touched. */
+void ring_destroy(ring_t *r);
+
+/**
+ * ring_reserve() - Make room for more items
+ * @r: ring to grow
+ * @n: number of items about to be pushed
+ *
+ * Return: false if the ring could not grow, in which case it is unchanged
+ */
+bool ring_reserve(ring_t *r, size_t n);
+
+/**
+ * ring_push_front() - Insert an item before the first one
+ * @r: ring to insert into
+ * @item: pointer to store
+ *
+ * Return: false if the ring was full and could not grow
+ */
+bool ring_push_front(ring_t *r, void *item);
+
+/**
+ * ring_push_back() - Insert an item after the last one
+ * @r: ring to insert into
+ * @item: pointer to store
+ *
+ * Return: false if the ring was full and could not grow
+ */
+bool ring_push_back(ring_t *r, void *item);
+
+/* Remove and return the first item, NULL if @r is empty */
+void *ring_pop_front(ring_t *r);
+
+/* Remove and return the last item, NULL if @r is empty */
+void *ring_pop_back(ring_t *r);
+
+/**
+ * ring_remove_at() - Remove an item from the middle of a ring
+ * @r: ring to remove from
+ * @i: index of the item, less than @r->size
+ *
+ * The items between the removed one and the closer end move by one slot.
+ *
+ * Return: the removed item
+ */
+void *ring_remove_at(ring_t *r, size_t i);
+
+/* Reverse the order of the items in @r without moving them */
+void ring_reverse(ring_t *r);
+
+/* Reverse the order of the items in @r @k at a time, leaving the last
+ * @r->size % @k items in place
+ */
+void ring_reverse_k(ring_t *r, size_t k);
+
+/* Empty @r, keeping its buffer */
+void ring_clear(ring_t *r);
+
+#endif /* LAB0_RING_H */
@@ -4,6 +4,7 @@ from __future__ import print_function
 import subprocess
 import sys
 import getopt
+import time
 
 
 
@@ -17,6 +18,8 @@ class Tracer:
     autograde = False
     useValgrind = False
     colored = False
+    backend = None
+    backends = None
 
     traceDict = {
         1: "trace-01-ops",
@@ -35,7 +38,25 @@ class Tracer:
         14: "trace-14-perf",
         15: "trace-15-perf",
         16: "trace-16-perf",
-        17: "trace-17-complexity"
+        17: "trace-17-complexity",
+        18: "trace-18-perf",
+        19: "trace-19-ops",
+        20: "trace-20-perf",
+        21: "trace-21-ops",
+        22: "trace-22-snapshot",
+        23: "trace-23-perf",
+        24: "trace-24-memalign",
+        25: "trace-25-ops",
+        26: "trace-26-memstat",
+        27: "trace-27-malloc",
+        28: "trace-28-sort",
+        29: "trace-29-sort",
+        30: "trace-30-sort",
+        31: "trace-31-backend",
+        32: "trace-32-backend",
+        33: "trace-33-stress",
+        34: "trace-34-complexity",
+        35: "trace-35-realloc"
     }
 
     traceProbs = {
@@ -55,10 +76,28 @@ class Tracer:
         14: "Trace-14",
         15: "Trace-15",
         16: "Trace-16",
-        17: "Trace-17"
+        17: "Trace-17",
+        18: "Trace-18",
+        19: "Trace-19",
+        20: "Trace-20",
+        21: "Trace-21",
+        22: "Trace-22",
+        23: "Trace-23",
+        24: "Trace-24",
+        25: "Trace-25",
+        26: "Trace-26",
+        27: "Trace-27",
+        28: "Trace-28",
+        29: "Trace-29",
+        30: "Trace-30",
+        31: "Trace-31",
+        32: "Trace-32",
+        33: "Trace-33",
+        34: "Trace-34",
+        35: "Trace-35"
     }
 
-    maxScores = [0, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5]
+    maxScores = [0, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5, 6]
 
     RED = '\033[91m'
     GREEN = '\033[92m'
@@ -69,13 +108,15 @@ class Tracer:
                  verbLevel=0,
                  autograde=False,
                  useValgrind=False,
-                 colored=False):
+                 colored=False,
+                 backends=None):
         if qtest != "":
             self.qtest = qtest
         self.verbLevel = verbLevel
         self.autograde = autograde
         self.useValgrind = useValgrind
         self.colored = colored
+        self.backends = backends
 
     def printInColor(self, text, color):
         if self.colored == False:
@@ -89,6 +130,8 @@ class Tracer:
         fname = "%s/%s.cmd" % (self.traceDirectory, self.traceDict[tid])
         vname = "%d" % self.verbLevel
         clist = self.command + ["-v", vname, "-f", fname]
+        if self.backend is not None:
+            clist += ["-b", "%d" % self.backend]
 
         try:
             retcode = subprocess.call(clist)
@@ -97,7 +140,47 @@ class Tracer:
             return False
         return retcode == 0
 
+    def runBigO(self):
+        # Fit the cost of every queue operation to a complexity class
+        print("---\tComplexity fit")
+        if self.useValgrind:
+            self.command = ['valgrind', self.qtest]
+        else:
+            self.command = [self.qtest]
+        clist = self.command + ["-v", "%d" % max(self.verbLevel, 1)]
+        try:
+            proc = subprocess.Popen(clist, stdin=subprocess.PIPE)
+            proc.communicate(b"bigo\n")
+        except Exception as e:
+            self.printInColor("Call of '%s' failed: %s" % (" ".join(clist), e), self.RED)
+            return False
+        if proc.returncode != 0:
+            self.printInColor("---\tComplexity fit failed", self.RED)
+            return False
+        self.printInColor("---\tComplexity fit passed", self.GREEN)
+        return True
+
     def run(self, tid=0):
+        if self.backends is None:
+            self.runPass(tid)
+            return
+        # Run the traces once per backend and compare their wall-clock times
+        times = {}
+        ok = True
+        for b in self.backends:
+            self.backend = b
+            times[b] = {}
+            ok = self.runPass(tid, times[b]) and ok
+        if len(self.backends) > 1:
+            print("---\tTrace\t\t" +
+                  "\t".join("Backend %d" % b for b in self.backends))
+            for t in times[self.backends[0]]:
+                print("---\t%s\t" % self.traceDict[t] +
+                      "\t".join("%.2f s" % times[b][t] for b in self.backends))
+        if not ok:
+            sys.exit(1)
+
+    def runPass(self, tid=0, times=None):
         scoreDict = {k: 0 for k in self.traceDict.keys()}
         print("---\tTrace\t\tPoints")
         if tid == 0:
@@ -105,10 +188,11 @@ class Tracer:
         else:
             if not tid in self.traceDict:
                 self.printInColor("ERROR: Invalid trace ID %d" % tid, self.RED)
-                return
+                return False
             tidList = [tid]
         score = 0
         maxscore = 0
+        start = time.time()
         if self.useValgrind:
             self.command = ['valgrind', self.qtest]
         else:
@@ -117,7 +201,10 @@ class Tracer:
             tname = self.traceDict[t]
             if self.verbLevel > 0:
                 print("+++ TESTING trace %s:" % tname)
+            traceStart = time.time()
             ok = self.runTrace(t)
+            if times is not None:
+                times[t] = time.time() - traceStart
             maxval = self.maxScores[t]
             tval = maxval if ok else 0
             if tval < maxval:
@@ -131,6 +218,9 @@ class Tracer:
             self.printInColor("---\tTOTAL\t\t%d/%d" % (score, maxscore), self.RED)
         else:
             self.printInColor("---\tTOTAL\t\t%d/%d" % (score, maxscore), self.GREEN)
+        if self.backend is not None:
+            # Wall-clock time, to compare the throughput of the backends
+            print("---\tBackend %d\t%.2f s" % (self.backend, time.time() - start))
         if self.autograde:
             # Generate JSON string
             jstring = '{"scores": {'
@@ -143,15 +233,21 @@ class Tracer:
             jstring += '}}'
             print(jstring)
         if score < maxscore:
+            if self.backends is not None:
+                return False
             sys.exit(1)
+        return True
 
 def usage(name):
-    print("Usage: %s [-h] [-p PROG] [-t TID] [-v VLEVEL] [--valgrind] [-c]" % name)
+    print("Usage: %s [-h] [-p PROG] [-t TID] [-v VLEVEL] [-b BACKENDS] [--valgrind] [-c] [--bigo]" % name)
     print("  -h        Print this message")
     print("  -p PROG   Program to test")
     print("  -t TID    Trace ID to test")
     print("  -v VLEVEL Set verbosity level (0-3)")
+    print("  -b BACKENDS Run the traces on queues of each of the comma separated")
+    print("             BACKENDS and compare the time they take")
     print("  -c Enable colored text")
+    print("  --bigo    Fit each queue operation to a complexity class instead")
     sys.exit(0)
 
 
@@ -163,8 +259,10 @@ def run(name, args):
     autograde = False
     useValgrind = False
     colored = False
+    bigo = False
+    backends = None
 
-    optlist, args = getopt.getopt(args, 'hp:t:v:A:c', ['valgrind'])
+    optlist, args = getopt.getopt(args, 'hp:t:v:A:cb:', ['valgrind', 'bigo'])
     for (opt, val) in optlist:
         if opt == '-h':
             usage(name)
@@ -181,6 +279,10 @@ def run(name, args):
             useValgrind = True
         elif opt == '-c':
             colored = True
+        elif opt == '--bigo':
+            bigo = True
+        elif opt == '-b':
+            backends = [int(b) for b in val.split(",")]
         else:
             print("Unrecognized option '%s'" % opt)
             usage(name)
@@ -190,7 +292,12 @@ def run(name, args):
                verbLevel=vlevel,
                autograde=autograde,
                useValgrind=useValgrind,
-               colored=colored)
+               colored=colored,
+               backends=backends)
+    if bigo:
+        if not t.runBigO():
+            sys.exit(1)
+        return
     t.run(tid)
 
 
@@ -0,0 +1,376 @@
+/* Snapshots of a chain of queues, see snapshot.h */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "report.h"
+
+/* Snapshots keep their own bookkeeping in regular memory */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "hash.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC "lab0snap"
+#define SNAPSHOT_VERSION 1
+
+/* A snapshot is laid out as
+ *   snapshot_header_t
+ *   @queues + 1 uint64_t, queue i holding entries [i] up to [i + 1] of the
+ *   index
+ *   @elements uint64_t, the index, where each string starts in the pool
+ *   @pool_size bytes, the pool of null-terminated strings
+ * Everything before the pool is made of 64-bit words, so the file can be
+ * used right where it is mapped.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t queues;
+    uint64_t current; /* position of the current queue, @queues if none */
+    uint64_t elements;
+    uint64_t pool_size;
+} snapshot_header_t;
+
+/* Smallest hash index of the pool worth allocating */
+#define POOL_INDEX_MIN 1024
+
+typedef struct {
+    uint64_t hash;
+    uint64_t at; /* offset of the string plus one, zero if the slot is unused */
+} pool_slot_t;
+
+/* Strings written so far, each once, with a hash index to find them again */
+typedef struct {
+    char *data;
+    size_t size, cap;
+    pool_slot_t *slot;
+    size_t slot_cap, count;
+} pool_t;
+
+/* Double the index of @pool, keeping its load factor at or below one half */
+static bool pool_grow(pool_t *pool)
+{
+    size_t cap = pool->slot_cap ? 2 * pool->slot_cap : POOL_INDEX_MIN;
+    pool_slot_t *slot = malloc(sizeof(pool_slot_t) * cap);
+    if (!slot)
+        return false;
+    memset(slot, 0, sizeof(pool_slot_t) * cap);
+
+    for (size_t i = 0; i < pool->slot_cap; i++) {
+        if (!pool->slot[i].at)
+            continue;
+        size_t j = pool->slot[i].hash & (cap - 1);
+        while (slot[j].at)
+            j = (j + 1) & (cap - 1);
+        slot[j] = pool->slot[i];
+    }
+    free(pool->slot);
+    pool->slot = slot;
+    pool->slot_cap = cap;
+    return true;
+}
+
+/* Return the offset of @s in @pool, adding it unless it is there already,
+ * or UINT64_MAX if it could not be added
+ */
+static uint64_t pool_add(pool_t *pool, const char *s, size_t len)
+{
+    if (2 * (pool->count + 1) > pool->slot_cap && !pool_grow(pool))
+        return UINT64_MAX;
+
+    uint64_t hash = hash_bytes(s, len, 0);
+    size_t mask = pool->slot_cap - 1;
+    size_t i = hash & mask;
+    for (; pool->slot[i].at; i = (i + 1) & mask) {
+        uint64_t at = pool->slot[i].at - 1;
+        if (pool->slot[i].hash == hash && at + len < pool->size &&
+            !memcmp(pool->data + at, s, len + 1))
+            return at;
+    }
+
+    if (pool->size + len + 1 > pool->cap) {
+        size_t cap = pool->cap ? 2 * pool->cap : 4096;
+        while (cap < pool->size + len + 1)
+            cap *= 2;
+        char *data = realloc(pool->data, cap);
+        if (!data)
+            return UINT64_MAX;
+        pool->data = data;
+        pool->cap = cap;
+    }
+    uint64_t at = pool->size;
+    memcpy(pool->data + at, s, len + 1);
+    pool->size += len + 1;
+    pool->slot[i].hash = hash;
+    pool->slot[i].at = at + 1;
+    pool->count++;
+    return at;
+}
+
+/* Return the file mode creation mask, which can only be read by setting it */
+static mode_t current_umask()
+{
+    mode_t mask = umask(0);
+    umask(mask);
+    return mask;
+}
+
+bool snapshot_save(const char *file,
+                   struct list_head *chain,
+                   const queue_contex_t *current)
+{
+    snapshot_header_t hdr = {.version = SNAPSHOT_VERSION,
+                             .current = UINT64_MAX};
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    queue_contex_t *ctx;
+    list_for_each_entry (ctx, chain, chain) {
+        if (ctx == current)
+            hdr.current = hdr.queues;
+        hdr.queues++;
+        hdr.elements += q_size(ctx->q);
+    }
+    if (hdr.current == UINT64_MAX)
+        hdr.current = hdr.queues;
+
+    char *tmp = NULL;
+    uint64_t *table = malloc(sizeof(uint64_t) * (hdr.queues + 1));
+    uint64_t *index = malloc(sizeof(uint64_t) * (hdr.elements + 1));
+    pool_t pool = {0};
+    bool ok = table && index;
+
+    /* Runs of elements sharing a string, as interning leaves them, are
+     * looked up only once
+     */
+    uint64_t k = 0, q = 0;
+    list_for_each_entry (ctx, chain, chain) {
+        if (!ok)
+            break;
+        table[q++] = k;
+        if (!ctx->q)
+            continue;
+        q_link(ctx->q);
+        const char *last = NULL;
+        uint64_t at = 0;
+        element_t *e;
+        list_for_each_entry (e, ctx->q, list) {
+            if (e->value != last) {
+                at = pool_add(&pool, e->value, e->len);
+                if (at == UINT64_MAX) {
+                    ok = false;
+                    break;
+                }
+                last = e->value;
+            }
+            index[k++] = at;
+        }
+    }
+    if (!ok) {
+        report(1, "ERROR: Could not allocate space to save queues");
+        goto out;
+    }
+    table[q] = k;
+    hdr.pool_size = pool.size;
+
+    /* Queues loaded from @file still refer to its mapping, so the snapshot
+     * is written to a new file that then takes the name over, leaving the
+     * old one to them
+     */
+    tmp = malloc(strlen(file) + sizeof(".XXXXXX"));
+    if (!tmp) {
+        report(1, "ERROR: Could not allocate space to save queues");
+        ok = false;
+        goto out;
+    }
+    strcpy(tmp, file);
+    strcat(tmp, ".XXXXXX");
+    int fd = mkstemp(tmp);
+    FILE *f = fd < 0 ? NULL : fdopen(fd, "wb");
+    if (!f) {
+        report(1, "ERROR: Could not open snapshot file '%s'", file);
+        if (fd >= 0) {
+            close(fd);
+            remove(tmp);
+        }
+        ok = false;
+        goto out;
+    }
+    ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+         fwrite(table, sizeof(uint64_t), hdr.queues + 1, f) ==
+             hdr.queues + 1 &&
+         fwrite(index, sizeof(uint64_t), hdr.elements, f) == hdr.elements &&
+         fwrite(pool.data, 1, pool.size, f) == pool.size;
+    /* mkstemp() makes the file private, unlike fopen() */
+    if (fchmod(fd, 0666 & ~current_umask()))
+        ok = false;
+    if (fclose(f))
+        ok = false;
+    if (ok && rename(tmp, file))
+        ok = false;
+    if (!ok) {
+        report(1, "ERROR: Could not write snapshot file '%s'", file);
+        remove(tmp);
+    }
+
+out:
+    free(tmp);
+    free(table);
+    free(index);
+    free(pool.data);
+    free(pool.slot);
+    return ok;
+}
+
+/* A mapped snapshot, unmapped along with the last element pointing into it */
+typedef struct {
+    q_view_t view;
+    void *map;
+    size_t size;
+} snapshot_view_t;
+
+static void view_release(q_view_t *view)
+{
+    snapshot_view_t *v = (snapshot_view_t *) view;
+    munmap(v->map, v->size);
+    free(v);
+}
+
+/* Check that the snapshot mapped at @map can be used as is, since the queues
+ * will refer to it without any further check.
+ *
+ * Return: NULL if it can, or what is wrong with it
+ */
+static const char *snapshot_check(const char *map, size_t size)
+{
+    const snapshot_header_t *hdr = (const snapshot_header_t *) map;
+    if (size < sizeof(*hdr) ||
+        memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)))
+        return "not a snapshot";
+    if (hdr->version != SNAPSHOT_VERSION)
+        return "unsupported version";
+
+    /* Sizes are checked one at a time so that none of the sums overflows */
+    size_t avail = size - sizeof(*hdr);
+    if (hdr->queues + 1ULL > avail / sizeof(uint64_t))
+        return "truncated queue table";
+    avail -= (hdr->queues + 1ULL) * sizeof(uint64_t);
+    if (hdr->elements > avail / sizeof(uint64_t))
+        return "truncated index";
+    avail -= hdr->elements * sizeof(uint64_t);
+    if (hdr->pool_size != avail)
+        return "truncated string pool";
+
+    const uint64_t *table = (const uint64_t *) (hdr + 1);
+    const uint64_t *index = table + hdr->queues + 1;
+    const char *pool = (const char *) (index + hdr->elements);
+    if (hdr->current > hdr->queues)
+        return "no such current queue";
+    if (table[0] || table[hdr->queues] != hdr->elements)
+        return "queue table does not match index";
+    for (uint32_t i = 0; i < hdr->queues; i++) {
+        if (table[i] > table[i + 1] || table[i + 1] - table[i] > INT_MAX)
+            return "queue table does not match index";
+    }
+
+    /* With a null byte at its end, no string can run past the pool */
+    if (hdr->pool_size && pool[hdr->pool_size - 1])
+        return "unterminated string";
+    for (uint64_t i = 0; i < hdr->elements; i++) {
+        if (index[i] >= hdr->pool_size)
+            return "string out of the pool";
+    }
+    return NULL;
+}
+
+int snapshot_load(const char *file,
+                  struct list_head *chain,
+                  queue_contex_t **current)
+{
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        report(1, "ERROR: Could not open snapshot file '%s'", file);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || (size_t) st.st_size < sizeof(snapshot_header_t)) {
+        report(1, "ERROR: Could not load snapshot file '%s': %s", file,
+               "not a snapshot");
+        close(fd);
+        return -1;
+    }
+    size_t size = st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        report(1, "ERROR: Could not map snapshot file '%s'", file);
+        return -1;
+    }
+
+    const char *why = snapshot_check(map, size);
+    snapshot_view_t *v = why ? NULL : malloc(sizeof(snapshot_view_t));
+    if (!v) {
+        report(1, "ERROR: Could not load snapshot file '%s': %s", file,
+               why ? why : "out of memory");
+        munmap(map, size);
+        return -1;
+    }
+    /* Hold a reference while the queues are built, so that a failure
+     * cannot unmap the file under our feet
+     */
+    v->view.refs = 1;
+    v->view.release = view_release;
+    v->map = map;
+    v->size = size;
+
+    const snapshot_header_t *hdr = map;
+    const uint64_t *table = (const uint64_t *) (hdr + 1);
+    const uint64_t *index = table + hdr->queues + 1;
+    const char *pool = (const char *) (index + hdr->elements);
+
+    LIST_HEAD(loaded);
+    *current = NULL;
+    bool ok = true;
+    for (uint32_t i = 0; i < hdr->queues && ok; i++) {
+        queue_contex_t *ctx = malloc(sizeof(queue_contex_t));
+        struct list_head *q = ctx ? q_new() : NULL;
+        if (!q) {
+            free(ctx);
+            ok = false;
+            break;
+        }
+        list_add_tail(&ctx->chain, &loaded);
+        ctx->q = q;
+        ctx->size = table[i + 1] - table[i];
+        ctx->id = 0;
+        ok = q_insert_tail_view(q, pool, index + table[i], ctx->size,
+                                &v->view);
+        if (i == hdr->current)
+            *current = ctx;
+    }
+    int queues = hdr->queues;
+
+    if (ok) {
+        list_splice_tail(&loaded, chain);
+    } else {
+        report(1, "ERROR: Could not allocate queues to load '%s'", file);
+        queue_contex_t *ctx, *safe;
+        list_for_each_entry_safe (ctx, safe, &loaded, chain) {
+            q_free(ctx->q);
+            free(ctx);
+        }
+        *current = NULL;
+        queues = -1;
+    }
+
+    if (!--v->view.refs)
+        view_release(&v->view);
+    return queues;
+}
@@ -0,0 +1,49 @@
+#ifndef LAB0_SNAPSHOT_H
+#define LAB0_SNAPSHOT_H
+
+/* Snapshots of a chain of queues on disk.
+ *
+ * A snapshot holds the strings of every queue once each, in a pool at the end
+ * of the file, and an index giving where in the pool the string of each
+ * element starts. Loading maps the file into memory and points the elements
+ * at the pool, so no string is read, let alone copied, until it is used. The
+ * mapping goes away with the last element referring to it.
+ *
+ * Snapshots are meant to be read back on the machine that wrote them: their
+ * integers are in its byte order.
+ */
+
+#include <stdbool.h>
+
+#include "list.h"
+#include "queue.h"
+
+/**
+ * snapshot_save() - Write a chain of queues to a file
+ * @file: path of the file, replaced if it exists
+ * @chain: list of queue_contex_t to save, in order
+ * @current: queue on @chain to make current again on loading, or NULL
+ *
+ * Return: false if the file could not be written, which is reported
+ */
+bool snapshot_save(const char *file,
+                   struct list_head *chain,
+                   const queue_contex_t *current);
+
+/**
+ * snapshot_load() - Read back the chain of queues in a file
+ * @file: path of a file written by snapshot_save()
+ * @chain: list the queues are appended to, each as a new queue_contex_t
+ *         whose id is left for the caller to assign
+ * @current: receives the queue saved as current, NULL if there is none
+ *
+ * New queues are created with the backend set by q_backend.
+ *
+ * Return: the number of queues loaded, -1 if the file could not be read or
+ * the queues built, which is reported and leaves @chain unchanged
+ */
+int snapshot_load(const char *file,
+                  struct list_head *chain,
+                  queue_contex_t **current);
+
+#endif /* LAB0_SNAPSHOT_H */
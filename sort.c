@@ -0,0 +1,627 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "queue.h"
+#include "sort.h"
+
+int sort_algo = SORT_MERGE;
+int sort_threads = 1;
+
+/* Compare the strings of two nodes in the requested order */
+static inline int node_cmp(const struct list_head *a,
+                           const struct list_head *b,
+                           bool descend)
+{
+    int ret = q_element_cmp(list_entry(a, element_t, list),
+                            list_entry(b, element_t, list));
+    return descend ? -ret : ret;
+}
+
+/* Stable merge of two null-terminated lists linked through ->next only.
+ * The ->prev pointers are left stale and rebuilt once the sort is done.
+ */
+static struct list_head *merge_runs(struct list_head *a,
+                                    struct list_head *b,
+                                    bool descend)
+{
+    struct list_head *head = NULL, **tail = &head;
+    for (;;) {
+        /* Ties are taken from @a, which always holds the earlier nodes */
+        if (node_cmp(a, b, descend) <= 0) {
+            *tail = a;
+            tail = &a->next;
+            a = a->next;
+            if (!a) {
+                *tail = b;
+                break;
+            }
+        } else {
+            *tail = b;
+            tail = &b->next;
+            b = b->next;
+            if (!b) {
+                *tail = a;
+                break;
+            }
+        }
+    }
+    return head;
+}
+
+/* Detach the longest ordered prefix of @*list and return it as a run.
+ * A strictly reversed prefix is flipped while it is being cut, so sorted
+ * and reverse-sorted input both come out as a single run.
+ */
+static struct list_head *cut_run(struct list_head **list,
+                                 size_t *len,
+                                 bool descend)
+{
+    struct list_head *run = *list, *cur = run->next;
+    size_t n = 1;
+
+    if (cur && node_cmp(run, cur, descend) > 0) {
+        run->next = NULL;
+        do {
+            struct list_head *next = cur->next;
+            cur->next = run;
+            run = cur;
+            cur = next;
+            n++;
+        } while (cur && node_cmp(run, cur, descend) > 0);
+    } else {
+        struct list_head *last = run;
+        while (cur && node_cmp(last, cur, descend) <= 0) {
+            last = cur;
+            cur = cur->next;
+            n++;
+        }
+        last->next = NULL;
+    }
+
+    *list = cur;
+    *len = n;
+    return run;
+}
+
+/* Pending runs are merged so that their lengths grow at least as fast as
+ * the Fibonacci numbers from the top of the stack down, which bounds the
+ * depth far below this for any list that fits in memory.
+ */
+#define MAX_PENDING_RUNS 96
+
+typedef struct {
+    struct list_head *list;
+    size_t len;
+} run_t;
+
+/* Merge runs[k] and runs[k + 1] into runs[k], dropping the top slot */
+static void merge_at(run_t *runs, size_t *n, size_t k, bool descend)
+{
+    runs[k].list = merge_runs(runs[k].list, runs[k + 1].list, descend);
+    runs[k].len += runs[k + 1].len;
+    if (k + 2 < *n)
+        runs[k + 1] = runs[k + 2];
+    (*n)--;
+}
+
+/* Restore the invariants on the pending stack, as in TimSort's merge_collapse
+ * with the extra check that keeps them valid deeper in the stack.
+ */
+static void collapse_runs(run_t *runs, size_t *n, bool descend)
+{
+    while (*n > 1) {
+        size_t k = *n - 2;
+        if ((k > 0 && runs[k - 1].len <= runs[k].len + runs[k + 1].len) ||
+            (k > 1 && runs[k - 2].len <= runs[k - 1].len + runs[k].len)) {
+            if (runs[k - 1].len < runs[k + 1].len)
+                k--;
+        } else if (runs[k].len > runs[k + 1].len) {
+            break;
+        }
+        merge_at(runs, n, k, descend);
+    }
+}
+
+/* Iterative natural merge sort: the list is consumed as a sequence of
+ * already ordered runs, which are merged bottom-up from a small stack. No
+ * recursion is involved.
+ */
+struct list_head *sort_merge(struct list_head *list, bool descend)
+{
+    run_t runs[MAX_PENDING_RUNS];
+    size_t n = 0;
+
+    while (list) {
+        runs[n].list = cut_run(&list, &runs[n].len, descend);
+        n++;
+        collapse_runs(runs, &n, descend);
+    }
+    while (n > 1)
+        merge_at(runs, &n, n - 2, descend);
+
+    return n ? runs[0].list : NULL;
+}
+
+/* Number of string bytes packed into sort_entry_t.key */
+#define KEY_BYTES sizeof(uint64_t)
+
+/* Ranges this short are finished with insertion sort */
+#define INSERTION_THRESHOLD 32
+
+static inline const element_t *entry_element(const sort_entry_t *e)
+{
+    return list_entry(e->node, element_t, list);
+}
+
+/* Pack the first KEY_BYTES bytes of @s, most significant first, padding with
+ * zeros once the string ends.
+ */
+static inline uint64_t key_prefix(const char *s)
+{
+    uint64_t key = 0;
+    for (size_t i = 0; i < KEY_BYTES; i++) {
+        key <<= 8;
+        if (*s)
+            key |= (unsigned char) *s++;
+    }
+    return key;
+}
+
+/* Byte @depth of the key, counting from the most significant one */
+static inline unsigned key_byte(uint64_t key, int depth)
+{
+    return (key >> (8 * (KEY_BYTES - 1 - depth))) & 0xff;
+}
+
+/* Full comparison. The strings only need to be touched when the keys tie and
+ * neither string ended inside the key.
+ */
+static int entry_cmp(const void *p1, const void *p2)
+{
+    const sort_entry_t *a = p1, *b = p2;
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    if (!(a->key & 0xff))
+        return 0;
+
+    /* Both strings are at least as long as the key, and the null byte of the
+     * shorter one ends the comparison
+     */
+    const element_t *ea = entry_element(a), *eb = entry_element(b);
+    uint32_t len = ea->len < eb->len ? ea->len : eb->len;
+    return memcmp(ea->value + KEY_BYTES, eb->value + KEY_BYTES,
+                  len + 1 - KEY_BYTES);
+}
+
+static void insertion_sort(sort_entry_t *a, size_t n)
+{
+    for (size_t i = 1; i < n; i++) {
+        sort_entry_t e = a[i];
+        size_t j = i;
+        for (; j > 0 && entry_cmp(&a[j - 1], &e) > 0; j--)
+            a[j] = a[j - 1];
+        a[j] = e;
+    }
+}
+
+/* Order entries whose keys are all equal by their strings. qsort() may
+ * allocate, so the nodes are linked through ->next and merge sorted as a
+ * list instead, which needs no memory beyond them. sort_array() rebuilds
+ * the links afterwards anyway.
+ */
+static void tie_sort(sort_entry_t *a, size_t n)
+{
+    for (size_t i = 0; i + 1 < n; i++)
+        a[i].node->next = a[i + 1].node;
+    a[n - 1].node->next = NULL;
+
+    struct list_head *node = sort_merge(a[0].node, false);
+    for (size_t i = 0; i < n; i++, node = node->next)
+        a[i].node = node;
+}
+
+/* In-place MSD radix sort (American flag sort) on byte @depth of the keys.
+ * Entries whose whole key ties are handed to tie_sort(), which only then has
+ * to look at the strings themselves.
+ */
+static void radix_sort(sort_entry_t *a, size_t n, int depth)
+{
+    if (n < INSERTION_THRESHOLD) {
+        insertion_sort(a, n);
+        return;
+    }
+    if (depth == KEY_BYTES) {
+        tie_sort(a, n);
+        return;
+    }
+
+    size_t count[256] = {0}, next[256], end[256];
+    for (size_t i = 0; i < n; i++)
+        count[key_byte(a[i].key, depth)]++;
+    for (size_t b = 0, sum = 0; b < 256; b++) {
+        next[b] = sum;
+        sum += count[b];
+        end[b] = sum;
+    }
+
+    /* Cycle every entry into its bucket */
+    for (unsigned b = 0; b < 256; b++) {
+        while (next[b] < end[b]) {
+            sort_entry_t e = a[next[b]];
+            unsigned c = key_byte(e.key, depth);
+            while (c != b) {
+                sort_entry_t tmp = a[next[c]];
+                a[next[c]++] = e;
+                e = tmp;
+                c = key_byte(e.key, depth);
+            }
+            a[next[b]++] = e;
+        }
+    }
+
+    /* Bucket 0 holds strings that have ended, which are all equal */
+    for (unsigned b = 1; b < 256; b++) {
+        if (count[b] > 1)
+            radix_sort(a + end[b] - count[b], count[b], depth + 1);
+    }
+}
+
+void sort_array(struct list_head *head,
+                sort_entry_t *scratch,
+                size_t n,
+                bool descend)
+{
+    size_t i = 0;
+    struct list_head *node;
+    list_for_each (node, head) {
+        scratch[i].key = key_prefix(list_entry(node, element_t, list)->value);
+        scratch[i].node = node;
+        i++;
+    }
+
+    radix_sort(scratch, n, 0);
+
+    struct list_head *prev = head;
+    for (i = 0; i < n; i++) {
+        node = scratch[descend ? n - 1 - i : i].node;
+        node->prev = prev;
+        prev->next = node;
+        prev = node;
+    }
+    prev->next = head;
+    head->prev = prev;
+}
+
+/* Buckets used by sort_radix() for each character position: one for strings
+ * that have ended, one per letter from 'a' to 'z', and one each for the bytes
+ * below and above that range.
+ */
+enum {
+    BUCKET_END,
+    BUCKET_BELOW,
+    BUCKET_A,
+    BUCKET_ABOVE = BUCKET_A + 26,
+    RADIX_BUCKETS,
+};
+
+/* Buckets this small are finished with insertion sort */
+#define BURST_THRESHOLD 16
+
+/* Beyond this many nested splits the remaining nodes are merge sorted, which
+ * bounds the stack use for pathological prefixes.
+ */
+#define RADIX_MAX_LEVEL 64
+
+static inline int radix_bucket(unsigned char c)
+{
+    if (!c)
+        return BUCKET_END;
+    if (c < 'a')
+        return BUCKET_BELOW;
+    if (c > 'z')
+        return BUCKET_ABOVE;
+    return BUCKET_A + c - 'a';
+}
+
+typedef struct {
+    struct list_head *first, *last;
+} chain_t;
+
+static inline void chain_append(chain_t *c, struct list_head *node)
+{
+    if (c->last)
+        c->last->next = node;
+    else
+        c->first = node;
+    c->last = node;
+}
+
+static inline void chain_concat(chain_t *c, chain_t tail)
+{
+    if (c->last)
+        c->last->next = tail.first;
+    else
+        c->first = tail.first;
+    c->last = tail.last;
+}
+
+/* Sort a short list whose strings all share their first @depth bytes */
+static chain_t insertion_chain(struct list_head *list,
+                               size_t depth,
+                               bool descend)
+{
+    chain_t c = {NULL, NULL};
+    while (list) {
+        struct list_head *node = list, **pos = &c.first;
+        const char *s = list_entry(node, element_t, list)->value + depth;
+        list = list->next;
+        for (; *pos; pos = &(*pos)->next) {
+            int ret =
+                strcmp(list_entry(*pos, element_t, list)->value + depth, s);
+            if ((descend ? -ret : ret) > 0)
+                break;
+        }
+        node->next = *pos;
+        *pos = node;
+        if (!node->next)
+            c.last = node;
+    }
+    return c;
+}
+
+/* Merge sort a list and find its last node */
+static chain_t merge_chain(struct list_head *list, bool descend)
+{
+    chain_t c = {sort_merge(list, descend), NULL};
+    for (c.last = c.first; c.last->next; c.last = c.last->next)
+        ;
+    return c;
+}
+
+/* MSD radix sort of @n nodes that share their first @depth bytes. Nodes are
+ * distributed into one bucket per character and the sorted buckets are
+ * concatenated in place, so nothing but the ->next links is rewritten.
+ */
+static chain_t radix_chain(struct list_head *list,
+                           size_t n,
+                           size_t depth,
+                           int level,
+                           bool descend)
+{
+    chain_t buckets[RADIX_BUCKETS];
+    size_t count[RADIX_BUCKETS];
+
+    for (;;) {
+        if (n < BURST_THRESHOLD)
+            return insertion_chain(list, depth, descend);
+        if (level >= RADIX_MAX_LEVEL)
+            return merge_chain(list, descend);
+
+        memset(buckets, 0, sizeof(buckets));
+        memset(count, 0, sizeof(count));
+        int b = 0;
+        while (list) {
+            struct list_head *node = list;
+            list = list->next;
+            b = radix_bucket(list_entry(node, element_t, list)->value[depth]);
+            chain_append(&buckets[b], node);
+            count[b]++;
+        }
+        buckets[b].last->next = NULL;
+
+        /* A shared character does not split anything; move on to the next
+         * position without nesting deeper.
+         */
+        if (count[b] < n || b == BUCKET_END || b == BUCKET_BELOW ||
+            b == BUCKET_ABOVE)
+            break;
+        list = buckets[b].first;
+        depth++;
+    }
+
+    chain_t sorted = {NULL, NULL};
+    for (int i = 0; i < RADIX_BUCKETS; i++) {
+        int b = descend ? RADIX_BUCKETS - 1 - i : i;
+        if (!count[b])
+            continue;
+        buckets[b].last->next = NULL;
+        if (b == BUCKET_END || count[b] == 1) {
+            /* Equal strings, nothing left to order */
+            chain_concat(&sorted, buckets[b]);
+        } else if (b == BUCKET_BELOW || b == BUCKET_ABOVE) {
+            chain_concat(&sorted, merge_chain(buckets[b].first, descend));
+        } else {
+            chain_concat(&sorted, radix_chain(buckets[b].first, count[b],
+                                              depth + 1, level + 1, descend));
+        }
+    }
+    return sorted;
+}
+
+struct list_head *sort_radix(struct list_head *list, bool descend)
+{
+    size_t n = 0;
+    for (struct list_head *node = list; node; node = node->next)
+        n++;
+    if (!n)
+        return NULL;
+
+    chain_t sorted = radix_chain(list, n, 0, 0, descend);
+    sorted.last->next = NULL;
+    return sorted.first;
+}
+
+/* Segments shorter than this are not worth handing to another thread */
+#define PARALLEL_MIN_NODES 8192
+
+/**
+ * sort_task_t - One unit of work for the sort thread pool
+ * @list: segment to sort, replaced by the result
+ * @other: segment to merge into @list, or NULL to sort @list
+ * @descend: order to sort or merge in
+ */
+typedef struct {
+    struct list_head *list;
+    struct list_head *other;
+    bool descend;
+} sort_task_t;
+
+/* Pool of worker threads shared by every parallel sort. Workers are started
+ * on demand and never exit; the thread calling pool_run() works on the batch
+ * as well.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    sort_task_t *tasks;
+    int n_tasks;
+    int next;     /* index of the first task nobody has taken */
+    int finished; /* number of tasks completed */
+    int n_workers;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static struct list_head *sort_segment(struct list_head *list, bool descend)
+{
+    return sort_algo == SORT_RADIX ? sort_radix(list, descend)
+                                   : sort_merge(list, descend);
+}
+
+static void run_task(sort_task_t *t)
+{
+    if (t->other)
+        t->list = merge_runs(t->list, t->other, t->descend);
+    else
+        t->list = sort_segment(t->list, t->descend);
+}
+
+/* Take and run tasks of the current batch. Called with pool.lock held. */
+static void drain_tasks(void)
+{
+    while (pool.next < pool.n_tasks) {
+        sort_task_t *t = &pool.tasks[pool.next++];
+        pthread_mutex_unlock(&pool.lock);
+        run_task(t);
+        pthread_mutex_lock(&pool.lock);
+        if (++pool.finished == pool.n_tasks)
+            pthread_cond_signal(&pool.done);
+    }
+}
+
+static void *pool_worker(void *arg)
+{
+    (void) arg;
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (pool.next >= pool.n_tasks)
+            pthread_cond_wait(&pool.work, &pool.lock);
+        drain_tasks();
+    }
+    return NULL;
+}
+
+/* Make sure @n workers are running and return how many there are. Workers
+ * start with every signal blocked, so the harness's SIGALRM and the console's
+ * signal handling always run on the main thread.
+ */
+static int pool_grow(int n)
+{
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    while (pool.n_workers < n) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, pool_worker, NULL))
+            break;
+        pthread_detach(tid);
+        pool.n_workers++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return pool.n_workers;
+}
+
+/* Run a batch of tasks and return once all of them are complete */
+static void pool_run(sort_task_t *tasks, int n)
+{
+    pthread_mutex_lock(&pool.lock);
+    pool.tasks = tasks;
+    pool.n_tasks = n;
+    pool.next = 0;
+    pool.finished = 0;
+    pthread_cond_broadcast(&pool.work);
+    drain_tasks();
+    while (pool.finished < pool.n_tasks)
+        pthread_cond_wait(&pool.done, &pool.lock);
+    pool.tasks = NULL;
+    pool.n_tasks = 0;
+    pool.next = 0;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+static struct list_head *sort_parallel(struct list_head *list,
+                                       size_t n,
+                                       int parts,
+                                       bool descend)
+{
+    sort_task_t tasks[MAX_SORT_THREADS];
+
+    /* Cut the list into @parts segments of nearly equal length */
+    for (int i = 0; i < parts; i++) {
+        size_t len = n / parts + ((size_t) i < n % parts);
+        tasks[i].list = list;
+        tasks[i].other = NULL;
+        tasks[i].descend = descend;
+        while (--len)
+            list = list->next;
+        struct list_head *last = list;
+        list = list->next;
+        last->next = NULL;
+    }
+    pool_run(tasks, parts);
+
+    /* Merge neighbours pairwise; the earlier segment stays on the left so
+     * equal strings keep their order.
+     */
+    for (int step = 1; step < parts; step *= 2) {
+        sort_task_t merges[MAX_SORT_THREADS / 2];
+        int m = 0;
+        for (int i = 0; i + step < parts; i += 2 * step) {
+            merges[m].list = tasks[i].list;
+            merges[m].other = tasks[i + step].list;
+            merges[m].descend = descend;
+            m++;
+        }
+        pool_run(merges, m);
+        for (int i = 0, j = 0; i + step < parts; i += 2 * step)
+            tasks[i].list = merges[j++].list;
+    }
+    return tasks[0].list;
+}
+
+struct list_head *sort_list(struct list_head *list, size_t n, bool descend)
+{
+    int parts = sort_threads;
+    if (parts > MAX_SORT_THREADS)
+        parts = MAX_SORT_THREADS;
+    if ((size_t) parts > n / PARALLEL_MIN_NODES)
+        parts = n / PARALLEL_MIN_NODES;
+    if (parts > 1)
+        parts = pool_grow(parts - 1) + 1;
+    if (parts < 2)
+        return sort_segment(list, descend);
+
+    /* Hold off the time limit while other threads work on the nodes */
+    sigset_t alrm, old;
+    sigemptyset(&alrm);
+    sigaddset(&alrm, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alrm, &old);
+    list = sort_parallel(list, n, parts, descend);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return list;
+}
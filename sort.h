@@ -0,0 +1,100 @@
+#ifndef LAB0_SORT_H
+#define LAB0_SORT_H
+
+/* Alternative engines behind q_sort().
+ *
+ * The default engine sorts the linked list in place. The others trade some
+ * memory for locality, and q_sort() falls back to the default whenever an
+ * engine cannot run on a given queue.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "list.h"
+
+typedef enum {
+    SORT_MERGE, /* Natural merge sort on the list itself */
+    SORT_ARRAY, /* Radix sort on an array of key prefixes and node pointers */
+    SORT_RADIX, /* MSD radix sort distributing the list nodes into buckets */
+    N_SORT_ALGO,
+} sort_algo_t;
+
+/* Engine used by q_sort(), one of sort_algo_t */
+extern int sort_algo;
+
+/* Upper bound for sort_threads */
+#define MAX_SORT_THREADS 64
+
+/* Number of threads the list engines may split a sort across */
+extern int sort_threads;
+
+/**
+ * sort_list() - Sort a list with the list engine selected by sort_algo
+ * @list: first node of a list terminated by a NULL ->next
+ * @n: number of nodes in @list
+ * @descend: whether or not to sort in descending order
+ *
+ * With sort_threads above one, a long list is cut into that many contiguous
+ * segments which are sorted concurrently and then merged pairwise, again
+ * concurrently, until one list is left. Neither path allocates memory.
+ * SIGALRM is held off while the worker threads own the nodes, so a time limit
+ * that expires meanwhile is reported once the sort is complete.
+ *
+ * Return: the first node of the sorted list, whose ->prev links are stale
+ */
+struct list_head *sort_list(struct list_head *list, size_t n, bool descend);
+
+/**
+ * sort_merge() - Stable natural merge sort
+ * @list: first node of a list terminated by a NULL ->next
+ * @descend: whether or not to sort in descending order
+ *
+ * Only the ->next links are maintained; ->prev is left for the caller to
+ * rebuild.
+ *
+ * Return: the first node of the sorted list
+ */
+struct list_head *sort_merge(struct list_head *list, bool descend);
+
+/**
+ * sort_radix() - MSD radix sort specialized for lowercase strings
+ * @list: first node of a list terminated by a NULL ->next
+ * @descend: whether or not to sort in descending order
+ *
+ * Characters 'a' to 'z' each get a bucket, so strings over that alphabet
+ * never have a common prefix compared twice. Any other byte is still ordered
+ * correctly, just by comparison. As with sort_merge(), ->prev is left stale.
+ *
+ * Return: the first node of the sorted list
+ */
+struct list_head *sort_radix(struct list_head *list, bool descend);
+
+/**
+ * sort_entry_t - Slot of the scratch array used by SORT_ARRAY
+ * @key: first bytes of the string, packed so that integer order is string
+ *       order
+ * @node: the list node the key was taken from
+ */
+typedef struct {
+    uint64_t key;
+    struct list_head *node;
+} sort_entry_t;
+
+/**
+ * sort_array() - Sort a queue through a contiguous array of entries
+ * @head: header of queue
+ * @scratch: array with room for at least @n entries
+ * @n: number of elements in queue
+ * @descend: whether or not to sort in descending order
+ *
+ * The nodes are gathered into @scratch, sorted there and relinked in one
+ * pass, so this neither allocates nor frees.
+ */
+void sort_array(struct list_head *head,
+                sort_entry_t *scratch,
+                size_t n,
+                bool descend);
+
+#endif /* LAB0_SORT_H */
@@ -0,0 +1,18 @@
+# Test performance of delete duplicate on a sorted queue of a million elements
+option fail 0
+option malloc 0
+new
+it aardvark 250000
+it bear
+it cat 250000
+it dolphin
+it gerbil 250000
+it jaguar
+it lion 249996
+it zebra
+dedup
+rh bear
+rh dolphin
+rh jaguar
+rh zebra
+size
@@ -0,0 +1,32 @@
+# Test of delete duplicate by hash on unsorted queues
+new
+it gerbil
+it lion
+it bear
+it gerbil
+it zebra
+it lion
+it gerbil
+dedup hash
+rh bear
+rh zebra
+size
+free
+new
+ih dolphin 2
+ih bear
+it dolphin
+dedup hash
+rh bear
+size
+free
+new
+it gerbil
+it lion
+it gerbil
+option malloc 100
+dedup hash
+option malloc 0
+rh gerbil
+rh lion
+rh gerbil
@@ -0,0 +1,10 @@
+# Test performance of delete duplicate by hash on an unsorted queue of a
+# million elements
+option fail 0
+option malloc 0
+new
+ih RAND 250000
+it dolphin 250000
+ih RAND 250000
+it dolphin 250000
+dedup hash
@@ -0,0 +1,23 @@
+# Test of ascend, which keeps the nodes with nothing smaller after them
+new
+it b
+it a
+it c
+it d
+it a
+it e
+ascend
+rh a
+rh a
+rh e
+free
+new
+ih zebra
+ih lion
+ih gerbil
+ih bear
+ascend
+rh bear
+rh gerbil
+rh lion
+rh zebra
@@ -0,0 +1,21 @@
+# Test of save and load, saving over the file a loaded queue still refers to
+new
+it apple
+it banana
+it cherry
+save trace-22.snap
+free
+load trace-22.snap
+ih zzzzzzzzzzzzzzzzzzzz
+rt cherry
+save trace-22.snap
+show
+sort
+rh apple
+rh banana
+rh zzzzzzzzzzzzzzzzzzzz
+free
+load trace-22.snap
+rh zzzzzzzzzzzzzzzzzzzz
+rh apple
+rh banana
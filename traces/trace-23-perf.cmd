@@ -0,0 +1,20 @@
+# Test performance of repeated insert_head and insert_tail through the bulk
+# insertion functions
+option fail 0
+option malloc 0
+option bulk 1
+new
+ih dolphin 1000000
+it gerbil 1000000
+ih RAND 10000
+rh
+rt gerbil 1000
+size
+free
+option intern 1
+new
+it zebra 1000000
+ih bear 1000000
+rh bear 1000
+rt zebra 1000
+size
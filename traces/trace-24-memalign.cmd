@@ -0,0 +1,10 @@
+# Test that the aligned allocators of the harness refuse invalid alignments,
+# zero included, and honor valid ones
+memalign 0 16
+memalign 0 0
+memalign 3 16
+memalign 4 16
+memalign 8 0
+memalign 64 100
+memalign 4096 10
+memalign 1048576 8
@@ -0,0 +1,13 @@
+# Test of remove_head and remove_tail repeated n times, with an expected value
+# and without one
+new
+it 5 3
+it b 600
+ih c
+rh -n 2
+rh 5 2
+rt -n 599
+rt b
+size
+it 5
+rh 5
@@ -0,0 +1,14 @@
+# Test that allocations are accounted to the queue operations making them
+option profile 1
+new
+ih dolphin 100
+it gerbil 100
+ih RAND 50
+rh
+rt gerbil 10
+sort
+memstat
+memstat reset
+free
+memstat
+option profile 0
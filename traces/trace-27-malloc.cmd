@@ -0,0 +1,46 @@
+# Test that seeded, scheduled and per-site allocation failures repeat
+option fail 100
+new
+it a
+it b
+it c
+option seed 42
+option malloc 50
+it d
+it e
+it f
+it g
+it h
+it i
+option malloc 0
+rh a
+rh b
+rh c
+rh d
+rh g
+rh i
+size
+it a
+it b
+option failnth 2
+it c
+it d
+it e
+option failnth 0
+rh a
+rh b
+rh c
+rh e
+size
+failsite q_insert_tail
+it a
+ih b
+it c
+ih d
+failsite
+it e
+rh d
+rh b
+rh e
+size
+free
@@ -0,0 +1,50 @@
+# Test of the list radix sort engine, ascending and descending, with tied
+# keys and strings sharing long prefixes
+option sortalgo 2
+new
+it interning_gerbil
+it interning_bear
+it dolphin
+it interning_gerbil
+it interningx
+it inter
+it interning_ant
+ih interning_bear
+sort
+rh dolphin
+rh inter
+rh interning_ant
+rh interning_bear
+rh interning_bear
+rh interning_gerbil
+rh interning_gerbil
+rh interningx
+it interning_gerbil
+it interning_bear
+it dolphin
+it interning_gerbil
+it interningx
+it inter
+it interning_ant
+option descend 1
+sort
+rh interningx
+rh interning_gerbil
+rh interning_gerbil
+rh interning_bear
+rh interning_ant
+rh inter
+rh dolphin
+free
+new
+ih RAND 10000
+it interleaved_strings_sharing_a_prefix 1000
+ih interleaved_strings_sharing_a_prefiy 1000
+sort
+option descend 0
+sort
+reverse
+sort
+free
+option descend 0
+option sortalgo 0
@@ -0,0 +1,44 @@
+# Test of list sorts split across worker threads, on queues long enough to
+# be split, with tied keys and strings sharing long prefixes
+option threads 4
+new
+ih RAND 30000
+it interleaved_strings_sharing_a_prefix 5000
+ih interleaved_strings_sharing_a_prefiy 5000
+sort
+option descend 1
+sort
+option descend 0
+free
+new
+ih zebra_and_a_long_shared_prefix 10000
+it bear_and_a_long_shared_prefix 10000
+ih gerbil_and_a_long_shared_prefix 10000
+sort
+rh bear_and_a_long_shared_prefix 10000
+rh gerbil_and_a_long_shared_prefix 10000
+rh zebra_and_a_long_shared_prefix 10000
+free
+option sortalgo 2
+new
+ih RAND 30000
+it interleaved_strings_sharing_a_prefix 5000
+ih interleaved_strings_sharing_a_prefiy 5000
+sort
+option descend 1
+sort
+option descend 0
+free
+new
+ih zebra_and_a_long_shared_prefix 10000
+it bear_and_a_long_shared_prefix 10000
+ih gerbil_and_a_long_shared_prefix 10000
+option descend 1
+sort
+rh zebra_and_a_long_shared_prefix 10000
+rh gerbil_and_a_long_shared_prefix 10000
+rh bear_and_a_long_shared_prefix 10000
+free
+option descend 0
+option sortalgo 0
+option threads 1
@@ -0,0 +1,78 @@
+# Test of the ring backend, through operations that link its elements
+# into a list and store them back
+option backend 2
+new
+it gerbil 40
+ih bear 40
+it dolphin
+ih zebra
+rh zebra
+rt dolphin
+reverse
+rh gerbil 40
+rt bear 39
+rh bear
+size
+it c
+it a
+it b
+it a
+it c
+it d
+dedup hash
+rh b
+rh d
+size
+it gerbil
+ih bear 3
+it zebra
+it dolphin 2
+sort
+rh bear 3
+rh dolphin 2
+rh gerbil
+rh zebra
+ih a
+ih b
+ih b
+ih c
+dedup
+rh c
+rh a
+size
+it a
+it b
+it c
+it d
+it e
+swap
+rh b
+rh a
+rh d
+rh c
+rh e
+it a
+it b
+it c
+reverseK 2
+rh b
+rh a
+rh c
+it bear
+it dolphin 35
+it gerbil
+new
+it bear 10
+it lion 30
+new
+it dolphin
+it zebra 40
+merge
+rh bear 11
+rh dolphin 36
+rh gerbil
+rh lion 30
+rh zebra 40
+size
+free
+option backend 0
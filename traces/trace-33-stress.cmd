@@ -0,0 +1,8 @@
+# Test of the lock-free queue and the reclamation of its nodes, with
+# producers and consumers racing on up to 8 threads
+stress 4 20000
+stress 8 5000
+new
+it gerbil
+rh gerbil
+free
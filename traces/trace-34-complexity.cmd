@@ -0,0 +1,4 @@
+# Test if time complexity of q_size is constant
+option simulation 1
+size
+option simulation 0
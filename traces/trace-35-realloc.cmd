@@ -0,0 +1,14 @@
+# Test that realloc in the harness keeps the contents of a block and the
+# count of allocated blocks as it grows and shrinks, also when it fails
+memrealloc 16 4096 8 100000 1 0
+memrealloc 0 1 0 64
+memrealloc 100 100 99 101
+option seed 7
+option malloc 50
+memrealloc 16 64 8 4096 1 100000 32 65536 3 500 5000 7 40000 2
+memrealloc 1 2 4 8 16 32 64 128 256 512 1024 2048 4096 8192 16384 32768
+memrealloc 32768 16384 8192 4096 2048 1024 512 256 128 64 32 16 8 4 2 1 0
+option malloc 0
+new
+it gerbil
+free